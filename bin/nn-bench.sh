@@ -0,0 +1,51 @@
+#!/bin/bash -eu
+# Speed, latency and accuracy of each NN backend of aobaz over the
+# positions of CSA records. Each backend evaluates all positions in
+# batches of 1..max-batch (aobaz nnbench), and its results are compared
+# with the FP32 CPU evaluation of single positions (aobaz nndump) by
+# net-test -a. Set Q8 to a w.q8 file to include the INT8 tower.
+if [ $# -le 3 ]
+then
+    cmd=`basename $0`
+    echo usage: $cmd aobaz weights max-batch records.csa...
+    exit
+fi
+
+aobaz=$1
+wght=$2
+nbatch=$3
+shift 3
+records=("$@")
+nettest=`dirname $0`/net-test
+tmp=`mktemp -d`
+trap "rm -rf $tmp" EXIT
+
+$aobaz -q -cpu -w $wght nndump $tmp/ref.txt "${records[@]}" > $tmp/ref.log 2>&1
+
+bench() {
+    name=$1
+    shift
+    if ! $aobaz -q -w $wght -b $nbatch "$@" nnbench $tmp/$name.txt \
+	 "${records[@]}" > $tmp/$name.log 2>&1
+    then
+	echo "== $name: failed"
+	return
+    fi
+    if [ $name = opencl ] && ! grep -q "Initializing OpenCL" $tmp/$name.log
+    then
+	echo "== $name: not built in"
+	return
+    fi
+    echo "== $name"
+    grep '^{"batch_size"' $tmp/$name.log
+    $nettest -a $tmp/ref.txt $tmp/$name.txt
+}
+
+bench cpu-fp32 -cpu
+bench cpu-fp16 -cpu -cpu_prec fp16
+bench cpu-bf16 -cpu -cpu_prec bf16
+if [ -n "${Q8:-}" ]
+then
+    bench int8 -q8 $Q8
+fi
+bench opencl
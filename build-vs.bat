@@ -3,7 +3,7 @@
 @if "%~1" == "clean" (exit /b 0)
 @if "%~2" neq "" (echo Usage: %~n0 [clean] && exit /b 1)
 @set CXXFLAGS=/nologo /W4 /EHsc /Foobjs\ /Febin\ /Ox
-@set CPPFLAGS=/DUSE_SSE4 /DUSE_WINAPI /DNDEBUG /Isrc\common /Iwin\include
+@set CPPFLAGS=/DUSE_WINAPI /DNDEBUG /Isrc\common /Iwin\include
 @mkdir objs
 
 cl %CPPFLAGS% %CXXFLAGS% src\gencode\gencode.cpp
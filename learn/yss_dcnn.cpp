@@ -3085,10 +3085,11 @@ void shogi::prepare_kif_db(int fPW, int mini_batch, float *data, float *label_po
 				label_policy_visit[i][k] = 0.0f;
 			}
 			int playout_sum = p->v_playouts_sum[j];
-			label_policy_visit[i][playmove_id] = 1.0f / (float)playout_sum;		// ¸ߤʤ1õȤ
+			int n = p->vv_move_visit[j].size();
+			// no candidates -> playout cap fast search. value only.
+			if ( n > 0 ) label_policy_visit[i][playmove_id] = 1.0f / (float)playout_sum;		// ¸ߤʤ1õȤ
 
 			int found = 0;
-			int n = p->vv_move_visit[j].size();
 			for (k=0;k<n;k++) {
 				unsigned int x = p->vv_move_visit[j][k];
 				int b0 = x>>24;
@@ -3103,7 +3104,7 @@ void shogi::prepare_kif_db(int fPW, int mini_batch, float *data, float *label_po
 //				PRT("r=%5d:b0=%3d,b1=%3d,[%3d][%3d] (%02x,%02x,%02x,%02x)id=%5d,v=%3d,%6.4f\n",r,b0,b1,j,k,bz,az,tk,nf,id,visit,label_policy_visit[i][id]);
 				if ( id==playmove_id ) found = 1;
 			}
-			if ( found==0 ) PRT("no best move visit. id=%d\n",playmove_id);
+			if ( found==0 && n > 0 ) PRT("no best move visit. id=%d\n",playmove_id);
 		}
 
 		float *pd = (float *)data + ONE_SIZE * i;
@@ -51,6 +51,7 @@ static vector<int> devices;
 static time_point<system_clock> time_start;
 
 static bool is_posi(uint u) { return 0 < u; }
+static bool is_pct(uint u) { return u <= 100U; }
 
 static void on_terminate() {
   exception_ptr p = current_exception();
@@ -83,6 +84,12 @@ static void init() noexcept {
 			   {"PrintCSA",      "0"},
 			   {"VerboseEngine", "0"},
 			   {"KeepWeight",    "0"},
+			   {"PlayoutCapFast", "0"},
+			   {"PlayoutCapFull", "25"},
+			   {"ResignWinrate", "0"},
+			   {"ResignMoves",   "3"},
+			   {"NoResignRate",  "10"},
+			   {"WeightCache",   ""},
 			   {"Addr",          "127.0.0.1"},
 			   {"Port",          "20000"}};
   try { Config::read("autousi.cfg", m); } catch (exception &e) { die(e); }
@@ -91,6 +98,7 @@ static void init() noexcept {
   const char *cstr_dlog  = Config::get_cstr(m, "DirLog",     maxlen_path);
   const char *cstr_csa   = Config::get_cstr(m, "DirCSA",     maxlen_path);
   const char *cstr_addr  = Config::get_cstr(m, "Addr",       64);
+  const char *cstr_wcache = Config::get_cstr(m, "WeightCache", maxlen_path);
   uint size_queue   = Config::get<uint>  (m, "SizeSendQueue", is_posi);
   uint recvTO       = Config::get<uint>  (m, "RecvTO",        is_posi);
   uint sendTO       = Config::get<uint>  (m, "SendTO",        is_posi);
@@ -100,6 +108,11 @@ static void init() noexcept {
   uint max_csa      = Config::get<uint>  (m, "MaxCSA");
   uint keep_wght    = Config::get<uint>  (m, "KeepWeight");
   uint verbose_eng  = Config::get<uint>  (m, "VerboseEngine");
+  uint pcap_fast    = Config::get<uint>  (m, "PlayoutCapFast");
+  uint pcap_pct     = Config::get<uint>  (m, "PlayoutCapFull", is_pct);
+  uint resign_pct   = Config::get<uint>  (m, "ResignWinrate", is_pct);
+  uint resign_n     = Config::get<uint>  (m, "ResignMoves",   is_posi);
+  uint noresign_pct = Config::get<uint>  (m, "NoResignRate",  is_pct);
   uint port         = Config::get<ushort>(m, "Port");
   devices           = Config::getv<int>  (m, "Device");
   print_status      = Config::get<uint>  (m, "PrintStatus");
@@ -108,7 +121,8 @@ static void init() noexcept {
 		      send_bufsiz, max_retry, size_queue, keep_wght);
   OSI::handle_signal(on_signal);
   Pipe::get().start(cstr_cname, cstr_dlog, devices, cstr_csa, max_csa,
-		    verbose_eng);
+		    verbose_eng, pcap_fast, pcap_pct, resign_pct, resign_n,
+		    noresign_pct, cstr_wcache);
   time_start = system_clock::now();
   cout << "self-play start" << endl; }
 
@@ -175,6 +189,13 @@ static void output() noexcept {
   printf("- Send Status: Sent %d, Lost %d, Waiting %d\n",
 	 nsend, ndiscard, ntot - nsend - ndiscard);
 
+  uint nresign_test  = Pipe::get().get_nresign_test();
+  uint nresign_false = Pipe::get().get_nresign_false();
+  if (nresign_test)
+    printf("- Resign Check: False %d / Tested %d (%.1f%%)\n",
+	   nresign_false, nresign_test,
+	   100.0 * nresign_false / nresign_test);
+
   int64_t wght_id        = Client::get().get_wght_id();
   bool    is_downloading = Client::get().is_downloading();
   const char *buf_time   = Client::get().get_buf_wght_time();
@@ -64,6 +64,7 @@ public:
   time_point<system_clock> time_last;
   double speed_average, speed_rate;
   uint speed_nmove, nmove;
+  bool noresign[Color::ok_size];
   NodeRec node;
   FName flog;
   ofstream ofs;
@@ -147,6 +148,15 @@ static int read_id(USIEngine &c, int &version, string &settings) noexcept {
 
   return 0; }
 
+static bool is_lost(const Node &node, const Color &c) noexcept {
+  assert(node.get_type().is_term() && c.ok());
+  NodeType type = node.get_type();
+  if (type == SAux::resigned) return node.get_turn() == c;
+  if (type == SAux::windclrd) return node.get_turn() != c;
+  if (type == SAux::illegal_bwin) return c == SAux::white;
+  if (type == SAux::illegal_wwin) return c == SAux::black;
+  return false; }
+
 static void engine_out(USIEngine &c, const char *fmt, ...) noexcept {
   assert(fmt);
   char buf[65536];
@@ -167,9 +177,11 @@ static void engine_out(USIEngine &c, const char *fmt, ...) noexcept {
     if (errno == EPIPE) die(ERR_INT("engine no. %d terminates", c.get_id()));
     die(ERR_CLL("write")); } }
 
-static void engine_start(USIEngine &c, const FName &cname)
-  noexcept {
+static void engine_start(USIEngine &c, const FName &cname, uint pcap_fast,
+			 uint pcap_pct, uint resign_pct, uint resign_n,
+			 uint noresign_pct, const string &dwcache) noexcept {
   c.nmove = 0;
+  c.noresign[0] = c.noresign[1] = false;
   c.node.clear();
   c.update_wght();
 
@@ -186,16 +198,57 @@ static void engine_start(USIEngine &c, const FName &cname)
 	 c.get_wght()->get_len_fname() + 1U);
   char *argv[] = { a0.get(), a1, a2, a3, a4, a5, a6, a7.get(),
 		   nullptr, nullptr, nullptr, nullptr,
-		   nullptr, nullptr, nullptr, nullptr };
+		   nullptr, nullptr, nullptr, nullptr,
+		   nullptr, nullptr, nullptr, nullptr,
+		   nullptr, nullptr, nullptr, nullptr,
+		   nullptr, nullptr };
   int argc = 8;
   char opt_q[] = "-q";
   char opt_u[] = "-u";
   char opt_u_value[256];
+  char opt_pcap_n[] = "-pcap_n";
+  char opt_pcap_n_value[256];
+  char opt_pcap_pct[] = "-pcap_pct";
+  char opt_pcap_pct_value[256];
+  char opt_resign_pct[] = "-resign_pct";
+  char opt_resign_pct_value[256];
+  char opt_resign_n[] = "-resign_n";
+  char opt_resign_n_value[256];
+  char opt_noresign_pct[] = "-noresign_pct";
+  char opt_noresign_pct_value[256];
+  char opt_wcache[] = "-wcache";
+  unique_ptr<char []> opt_wcache_value(new char [dwcache.size() + 1U]);
+  memcpy(opt_wcache_value.get(), dwcache.c_str(), dwcache.size() + 1U);
+  char opt_wcrc[] = "-wcrc";
+  char opt_wcrc_value[17];
   sprintf(opt_u_value, "%i", c.get_device());
+  sprintf(opt_pcap_n_value, "%u", pcap_fast);
+  sprintf(opt_pcap_pct_value, "%u", pcap_pct);
+  sprintf(opt_resign_pct_value, "%u", resign_pct);
+  sprintf(opt_resign_n_value, "%u", resign_n);
+  sprintf(opt_noresign_pct_value, "%u", noresign_pct);
+  sprintf(opt_wcrc_value, "%016" PRIx64, c.get_wght()->get_crc64());
   if (!c.is_verbose()) argv[argc++] = opt_q;
   if (0 <= c.get_device()) {
     argv[argc++] = opt_u;
     argv[argc++] = opt_u_value; }
+  if (0 < pcap_fast) {
+    argv[argc++] = opt_pcap_n;
+    argv[argc++] = opt_pcap_n_value;
+    argv[argc++] = opt_pcap_pct;
+    argv[argc++] = opt_pcap_pct_value; }
+  if (0 < resign_pct) {
+    argv[argc++] = opt_resign_pct;
+    argv[argc++] = opt_resign_pct_value;
+    argv[argc++] = opt_resign_n;
+    argv[argc++] = opt_resign_n_value;
+    argv[argc++] = opt_noresign_pct;
+    argv[argc++] = opt_noresign_pct_value; }
+  if (!dwcache.empty()) {
+    argv[argc++] = opt_wcache;
+    argv[argc++] = opt_wcache_value.get();
+    argv[argc++] = opt_wcrc;
+    argv[argc++] = opt_wcrc_value; }
   c.open(path.get(), argv);
   
   c.ofs.open(c.flog.get_fname(), ios::trunc);
@@ -231,12 +284,15 @@ Pipe & Pipe::get() noexcept {
   static Pipe instance;
   return instance; }
 
-Pipe::Pipe() noexcept : _ngen_records(0) {}
+Pipe::Pipe() noexcept : _ngen_records(0), _nresign_test(0),
+  _nresign_false(0) {}
 Pipe::~Pipe() noexcept {}
 void Pipe::start(const char *cname, const char *dlog,
 		 const vector<int> &devices,  const char *cstr_csa,
-		 uint max_csa, uint verbose_eng) noexcept {
-  assert(cname && cstr_csa && dlog);
+		 uint max_csa, uint verbose_eng, uint pcap_fast,
+		 uint pcap_pct, uint resign_pct, uint resign_n,
+		 uint noresign_pct, const char *dwcache) noexcept {
+  assert(cname && cstr_csa && dlog && dwcache);
   if (devices.empty() || max_nchild < devices.size())
     die(ERR_INT("bad devices"));
   _cname.reset_fname(cname);
@@ -244,6 +300,12 @@ void Pipe::start(const char *cname, const char *dlog,
   _nchild      = static_cast<uint>(devices.size());
   _max_csa     = max_csa;
   _verbose_eng = verbose_eng;
+  _pcap_fast   = pcap_fast;
+  _pcap_pct    = pcap_pct;
+  _resign_pct  = resign_pct;
+  _resign_n    = resign_n;
+  _noresign_pct = noresign_pct;
+  _dwcache     = dwcache;
   _children.reset(new USIEngine [devices.size()]);
   for (uint u = 0; u < _nchild; ++u) {
     USIEngine & c = _children[u];
@@ -263,6 +325,14 @@ bool Pipe::play_update(char *line, class USIEngine &c) noexcept {
   
   char *token, *saveptr;
   token = OSI::strtok(line, " ,", &saveptr);
+  if (strcmp(token, "info") == 0) {
+    // the engine would have resigned here if resignation were enabled
+    token = OSI::strtok(nullptr, " ,", &saveptr);
+    if (!token || strcmp(token, "string") != 0) return false;
+    token = OSI::strtok(nullptr, " ,", &saveptr);
+    if (token && strcmp(token, "noresign") == 0)
+      c.noresign[node.get_turn().to_u()] = true;
+    return false; }
   if (strcmp(token, "bestmove") != 0) return false;
   
   // read played move
@@ -359,7 +429,8 @@ void Pipe::wait() noexcept {
   _selector.reset();
   for (uint u = 0; u < _nchild; ++u) {
     USIEngine &c = _children[u];
-    if (c.is_closed() && has_conn) engine_start(c, _cname);
+    if (c.is_closed() && has_conn) engine_start(c, _cname, _pcap_fast, _pcap_pct, _resign_pct, _resign_n,
+		 _noresign_pct, _dwcache);
     _selector.add(c); }
 
   _selector.wait(0, 500U);
@@ -400,6 +471,12 @@ void Pipe::wait() noexcept {
 	  s += c.node.get_type().to_str();
 	  _moves_id0.push(s); }
 	
+      // count false resignations of games played without resignation
+      for (uint uc = 0; uc < Color::ok_size; ++uc) {
+	if (!c.noresign[uc]) continue;
+	_nresign_test += 1U;
+	if (!is_lost(c.node, Color(uc))) _nresign_false += 1U; }
+
       Client::get().add_rec(c.node.record.c_str(), c.node.record.size());
       _ngen_records += 1U;
       write_record(c.node.record.c_str(), c.node.record.size(),
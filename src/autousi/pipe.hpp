@@ -13,7 +13,11 @@ class Pipe {
   std::unique_ptr<class USIEngine []> _children;
   OSI::Selector _selector;
   uint _nchild, _max_csa, _ngen_records, _verbose_eng;
+  uint _pcap_fast, _pcap_pct;
+  uint _resign_pct, _resign_n, _noresign_pct;
+  uint _nresign_test, _nresign_false;
   FName _cname, _dname_csa;
+  std::string _dwcache;
   Pipe() noexcept;
   ~Pipe() noexcept;
   Pipe(const Pipe &) = delete;
@@ -24,7 +28,9 @@ public:
   static Pipe & get() noexcept;
   void start(const char *cname, const char *dlog,
 	     const std::vector<int> &devices, const char *cstr_csa,
-	     uint max_csa, uint verbose_eng) noexcept;
+	     uint max_csa, uint verbose_eng, uint pcap_fast,
+	     uint pcap_pct, uint resign_pct, uint resign_n,
+	     uint noresign_pct, const char *dwcache) noexcept;
   void wait() noexcept;
   void end() noexcept;
   bool get_moves_id0(std::string &move) noexcept;
@@ -34,4 +40,6 @@ public:
   uint get_nmove(uint u) const noexcept;
   double get_speed_average(uint u) const noexcept;
   uint get_ngen_records() const noexcept { return _ngen_records; };
+  uint get_nresign_test() const noexcept { return _nresign_test; };
+  uint get_nresign_false() const noexcept { return _nresign_false; };
 };
@@ -7,6 +7,7 @@
 #include "osi.hpp"
 #include "xzi.hpp"
 #include "iobase.hpp"
+#include "wbin.hpp"
 #include <fstream>
 #include <limits>
 #include <type_traits>
@@ -141,6 +142,11 @@ bool IOAux::is_weight_ok(PtrLen<const char> plxz, uint64_t &digest) noexcept {
   PtrLen<char> pl(token,0);
   char *endptr;
 
+  // the binary format by the first bytes, which need not end with a delimiter
+  PtrLen<const char> plxz_head = plxz;
+  if (!xzd.head(&plxz_head, &pl, sizeof(WBin::magic))) return false;
+  if (WBin::is_magic(pl.p, pl.len)) return is_wbin_ok(plxz, digest);
+
   xzd.init();
   while (true) {
     pl.clear();
@@ -149,7 +155,6 @@ bool IOAux::is_weight_ok(PtrLen<const char> plxz, uint64_t &digest) noexcept {
     if (pl.len == 0) break;
     if (pl.len == sizeof(token)) return false;
     assert(pl.len < sizeof(token));
-    
     pl.p[pl.len] = '\0';
     errno = 0;
     strtof(token, &endptr);
@@ -158,6 +163,44 @@ bool IOAux::is_weight_ok(PtrLen<const char> plxz, uint64_t &digest) noexcept {
   digest = xzd.get_crc64();
   return true; }
 
+// the binary format of wbin.hpp, decoded as a whole
+bool IOAux::is_wbin_ok(PtrLen<const char> plxz, uint64_t &digest) noexcept {
+  assert(plxz.ok());
+  PtrLen<const char> plxz0 = plxz;
+  XZDecode<PtrLen<const char>, DevNul> xzd_len;
+  DevNul dev_nul;
+  if (!xzd_len.decode(&plxz0, &dev_nul, SIZE_MAX)) return false;
+  
+  size_t len = xzd_len.get_len_out();
+  if (len < WBin::size_head) return false;
+  unique_ptr<char []> ptr(new char [len]);
+  PtrLen<char> pl(ptr.get(), 0);
+  XZDecode<PtrLen<const char>, PtrLen<char>> xzd;
+  if (!xzd.decode(&plxz, &pl, len) || pl.len != len) return false;
+
+  WBin::Header head;
+  memcpy(&head, pl.p, sizeof(head));
+  if (!WBin::is_magic(head.magic, sizeof(head.magic))
+      || head.version != WBin::version
+      || head.nsection != (WBin::nsection_fixed
+			   + WBin::nsection_block * head.nblock)) return false;
+
+  const char *p    = pl.p + WBin::size_head;
+  size_t len_body  = len - WBin::size_head;
+  if (XZAux::crc64(p, len_body, 0) != head.crc64) return false;
+
+  size_t offset = WBin::align_up(sizeof(uint64_t) * head.nsection);
+  if (len_body < offset) return false;
+  for (uint u = 0; u < head.nsection; ++u) {
+    uint64_t count;
+    memcpy(&count, p + sizeof(uint64_t) * u, sizeof(count));
+    if ((len_body - offset) / sizeof(float) < count) return false;
+    offset += WBin::align_up(sizeof(float) * count); }
+  if (offset != len_body) return false;
+
+  digest = xzd.get_crc64();
+  return true; }
+
 void IOAux::grab_files(set<FNameID> &dir_list, const char *dname,
 		       const char *fmt, int64_t min_no) noexcept {
   assert(dname);
@@ -15,6 +15,7 @@ namespace IOAux {
   size_t make_time_stamp(char *p, size_t n, const char *fmt) noexcept;
   bool is_weight_ok(const char *fname, uint64_t &digest) noexcept;
   bool is_weight_ok(PtrLen<const char> plxz, uint64_t &digest) noexcept;
+  bool is_wbin_ok(PtrLen<const char> plxz, uint64_t &digest) noexcept;
   void grab_files(std::set<FNameID> &dir_list, const char *dname,
                   const char *fmt, int64_t min_no) noexcept;
   FNameID grab_max_file(const char *dname, const char *fmt) noexcept;
@@ -8,9 +8,16 @@
 #include <memory>
 #include <cassert>
 #include <cstdint>
-#if defined(USE_SSE4)
+// BMap keeps its 81 bits in one SSE2 register on any x86-64 build. Its
+// operations are a few instructions each, too short for a dispatch at
+// run time, so PTEST (SSE4.1) is used only where the build enables it.
+#if defined(__SSE2__) || defined(_M_X64)
+#  define BMAP_SSE
 #  include <emmintrin.h>
-#  include <smmintrin.h>
+#  if defined(__SSE4_1__) || defined(__AVX__)
+#    define BMAP_PTEST
+#    include <smmintrin.h>
+#  endif
 #endif
 
 namespace SAux {
@@ -100,7 +107,7 @@ class BMap {
   static constexpr uchar tbl_bmap_rel[Color::ok_size][3] = { {0U, 1U, 2U},
 							     {2U, 1U, 0U} };
 #include "tbl_bmap.inc"
-#if defined(USE_SSE4)
+#if defined(BMAP_SSE)
   union { __m128i _u128; uint32_t _data[4]; };
 #else
   uint32_t _data[3];
@@ -129,7 +136,7 @@ public:
       _data[2] ^= (1U << count); return 80U - count; }
     return 81U; }
 
-#if defined(USE_SSE4)
+#if defined(BMAP_SSE)
   explicit constexpr BMap(uint32_t u0, uint32_t u1,
 			  uint32_t u2) noexcept : _data{u0, u1, u2, 0} {}
   explicit constexpr BMap(const __m128i &m) noexcept : _u128(m) {}
@@ -158,15 +165,23 @@ public:
     assert(u < 3U);
     return _mm_extract_epi32(_u128, u); }
   */
+  static bool test_all_zeros(const __m128i &a, const __m128i &b) noexcept {
+#if defined(BMAP_PTEST)
+    return _mm_test_all_zeros(a, b);
+#else
+    __m128i tmp = _mm_cmpeq_epi8(_mm_and_si128(a, b), _mm_setzero_si128());
+    return _mm_movemask_epi8(tmp) == 0xffff;
+#endif
+  }
   bool operator==(const BMap &b) const noexcept {
     __m128i tmp = _mm_xor_si128(_u128, b._u128);
-    return _mm_test_all_zeros(tmp, tmp); }
+    return test_all_zeros(tmp, tmp); }
   bool operator!=(const BMap &b) const noexcept {
     __m128i tmp = _mm_xor_si128(_u128, b._u128);
-    return ! _mm_test_all_zeros(tmp, tmp); }
-  bool empty() const noexcept { return _mm_test_all_zeros(_u128, _u128); }
+    return ! test_all_zeros(tmp, tmp); }
+  bool empty() const noexcept { return test_all_zeros(_u128, _u128); }
   bool is_disjoint(const BMap &b) const noexcept {
-    return _mm_test_all_zeros(_u128, b._u128); }
+    return test_all_zeros(_u128, b._u128); }
 #else
   explicit constexpr BMap(uint32_t u0, uint32_t u1, uint32_t u2) noexcept
   : _data{u0, u1, u2} {}
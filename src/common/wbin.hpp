@@ -0,0 +1,47 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Binary weight file. It holds the lines of the text format (w*.txt)
+// after the version line, each as a section of floats, so it is read
+// without parsing and can be used in place after mmap(). All values are
+// little-endian.
+//
+//   offset 0   Header
+//   offset 64  uint64_t count[nsection], the number of floats in each
+//              section
+//   then each section in order, starting at a multiple of 64 bytes and
+//   padded with zeros
+//
+// crc64 covers everything after the header. aobaz tells this format
+// from the text by the magic, whatever the file name, and keeps its own
+// copy of this layout in src/usi-engine/Network.cpp.
+namespace WBin {
+  constexpr char magic[8]       = { 'A', 'O', 'B', 'A', 'W', 'B', 'I', 'N' };
+  constexpr uint32_t version    = 1U;
+  constexpr size_t   align      = 64U;
+  constexpr size_t   size_head  = 64U;
+  constexpr uint32_t nsection_fixed = 4U + 14U; // input layer and heads
+  constexpr uint32_t nsection_block = 8U;       // per residual block
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t version_text; // the first line of the text format
+    uint32_t nblock;
+    uint32_t nchannel;
+    uint32_t nsection;
+    uint32_t reserved;
+    uint64_t crc64;
+    char padding[24];
+  };
+  static_assert(sizeof(Header) == size_head, "bad WBin::Header");
+
+  inline size_t align_up(size_t u) noexcept {
+    return (u + align - 1U) / align * align; }
+  inline bool is_magic(const char *p, size_t len) noexcept {
+    return sizeof(magic) <= len && memcmp(p, magic, sizeof(magic)) == 0; }
+}
@@ -52,6 +52,9 @@ void XZBase::xzwrite(PtrLen<char> *out, size_t len) const noexcept {
 
 void XZBase::xzwrite(DevNul *, size_t) const noexcept {}
 
+void XZBase::xzwrite(XZSink *out, size_t len) const noexcept {
+  out->write(reinterpret_cast<const char *>(_outbuf), len); }
+
 size_t XZBase::xzread(PtrLen<const char> *pl) noexcept {
   assert(pl->ok());
   size_t len(pl->len);
@@ -310,12 +313,52 @@ bool XZDecode<T_IN, T_OUT>::getline(T_IN *in, T_OUT *out, size_t len_limit,
   die(ERR_INT("XZDecode::getline() failed: bad %s", msg));
   return false; }
 
+template <typename T_IN, typename T_OUT>
+bool XZDecode<T_IN, T_OUT>::head(T_IN *in, T_OUT *out, size_t len) noexcept {
+  assert(in && out && len <= sizeof(_outbuf));
+  lzma_action action(LZMA_RUN);
+  lzma_ret ret(LZMA_OK);
+
+  init();
+  while (true) {
+    size_t len_out = sizeof(_outbuf) - _strm.avail_out;
+    if (len <= len_out || ret == LZMA_STREAM_END) {
+      xzwrite(out, min(len, len_out));
+      return true; }
+    
+    if (action == LZMA_RUN && _strm.avail_in == 0) {
+      size_t len_in(xzread(in));
+      if (len_in == 0) action = LZMA_FINISH;
+      else {
+	_strm.next_in  = _inbuf;
+	_strm.avail_in = len_in; } }
+
+    ret = lzma_code(&_strm, action);
+    if (ret == LZMA_OK || ret == LZMA_STREAM_END) continue;
+    break; }
+
+  const char *msg;
+  switch (ret) {
+  case LZMA_FORMAT_ERROR:
+  case LZMA_OPTIONS_ERROR:
+  case LZMA_DATA_ERROR:
+  case LZMA_BUF_ERROR:
+    return false;
+    
+  case LZMA_MEM_ERROR: msg = "allocation"; break;
+  default:             msg = "XZDecode";   break; }
+  
+  die(ERR_INT("XZDecode::head() failed: bad %s", msg));
+  return false; }
+
 // template class XZEncode<PtrLen<const char>, int>;
 template class XZEncode<PtrLen<const char>, ofstream>;
 template class XZEncode<PtrLen<const char>, PtrLen<char>>;
 
 template class XZDecode<PtrLen<const char>, PtrLen<char>>;
+template class XZDecode<PtrLen<const char>, DevNul>;
 template class XZDecode<ifstream, ofstream>;
 template class XZDecode<ifstream, PtrLen<char>>;
 // template class XZDecode<int, PtrLen<char>>;
 template class XZDecode<ifstream, DevNul>;
+template class XZDecode<ifstream, XZSink>;
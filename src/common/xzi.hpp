@@ -17,6 +17,14 @@ namespace XZAux {
 
 class DevNul {};
 
+// Receives the decoded bytes chunk by chunk, so that they can be used
+// while the rest is decoded.
+class XZSink {
+public:
+  virtual ~XZSink() noexcept {}
+  virtual void write(const char *p, size_t len) noexcept = 0;
+};
+
 template <typename T> class PtrLen {
 public:
   T *p;
@@ -46,6 +54,7 @@ protected:
   void xzwrite(std::ofstream *pofs, size_t len) const noexcept;
   void xzwrite(PtrLen<char> *out, size_t len) const noexcept;
   void xzwrite(DevNul *out, size_t len) const noexcept;
+  void xzwrite(XZSink *out, size_t len) const noexcept;
   size_t xzread(PtrLen<const char> *pl) noexcept;
   size_t xzread(std::ifstream *pifs) noexcept;
   size_t xzread(int *fd) noexcept;
@@ -82,6 +91,8 @@ public:
   bool decode(T_IN *in, T_OUT *out, size_t size_limit) noexcept;
   bool getline(T_IN *in, T_OUT *out, size_t len_limit,
 	       const char *delims) noexcept;
+  // the first len bytes, or fewer if the stream is shorter
+  bool head(T_IN *in, T_OUT *out, size_t len) noexcept;
   size_t get_len_out() const noexcept { return _len_out_tot; }
   uint64_t get_crc64() const noexcept { return _crc64; }
 };
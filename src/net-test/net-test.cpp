@@ -4,7 +4,10 @@
 #include "osi.hpp"
 #include "shogibase.hpp"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -18,7 +21,15 @@ using std::endl;
 using policy_t = vector<pair<string, float>>;
 using namespace ErrAux;
 
+struct Entry {
+  vector<string> path;
+  vector<float> inputs;
+  float value;
+  policy_t policy; };
+
+static bool read_entry(std::istream &ifs, uint &uline, Entry &e) noexcept;
 static void do_test(std::istream &ifs) noexcept;
+static void do_accuracy(const char *fref, const char *ftest) noexcept;
 static void compare(const vector<string> &path, const vector<float> &inputs,
 		    float value, const policy_t &policy, uint udata) noexcept;
 
@@ -26,6 +37,12 @@ int main(int argc, char **argv) {
   if (argc == 1) {
     do_test(std::cin);
     return 0; }
+
+  // net-test -a fp32.txt int8.txt
+  if (std::strcmp(argv[1], "-a") == 0) {
+    if (argc != 4) die(ERR_INT("usage: net-test -a reference test"));
+    do_accuracy(argv[2], argv[3]);
+    return 0; }
   
   while (*++argv) {
     std::ifstream ifs(*argv);
@@ -33,69 +50,118 @@ int main(int argc, char **argv) {
     do_test(ifs); }
   return 0; }
   
-static void do_test(std::istream &ifs) noexcept {
+static bool read_entry(std::istream &ifs, uint &uline, Entry &e) noexcept {
+  // read position startpos moves...
+  std::string string_line;
+  if (! std::getline(ifs, string_line)) return false;
+  uline += 1U;
+
+  std::stringstream ss(string_line);
+  std::string token1, token2, token3;
+  ss >> token1 >> token2 >> token3;
+  if (token1 != "position" || token2 != "startpos" || token3 != "moves")
+    die(ERR_INT("bad line %u", uline));
+
+  e.path.clear();
+  while (ss >> token1) e.path.push_back(std::move(token1));
+
+  // input...
+  uline += 1U;
+  if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
+  ss.clear();
+  ss.str(string_line);
+  ss >> token1;
+  if (token1 != "input") die(ERR_INT("bad line %u", uline));
+
+  e.inputs.clear();
+  float f;
+  while (ss >> f) e.inputs.push_back(f);
+
+  // value...
+  uline += 1U;
+  if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
+  ss.clear();
+  ss.str(string_line);
+  ss >> token1;
+  if (token1 != "value") die(ERR_INT("bad line %u", uline));
+
+  ss >> e.value;
+
+  // policy...
+  uline += 1U;
+  if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
+  ss.clear();
+  ss.str(string_line);
+  ss >> token1;
+  if (token1 != "policy") die(ERR_INT("bad line %u", uline));
+
+  e.policy.clear();
+  while (ss >> token1 >> f) e.policy.emplace_back(std::move(token1), f);
 
-  for (uint uline = 0, udata = 0;;) {
+  // END
+  uline += 1U;
+  if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
+  if (string_line != "END") die(ERR_INT("bad line %u", uline));
+  return true; }
 
-    // read position startpos moves...
-    std::string string_line;
-    if (! std::getline(ifs, string_line)) break;
+static void do_test(std::istream &ifs) noexcept {
+  Entry e;
+  for (uint uline = 0, udata = 0; read_entry(ifs, uline, e);) {
     udata += 1U;
-    uline += 1U;
     std::cout << udata << std::endl;
-    
-    std::stringstream ss(string_line);
-    std::string token1, token2, token3;
-    ss >> token1 >> token2 >> token3;
-    if (token1 != "position" || token2 != "startpos" || token3 != "moves")
-      die(ERR_INT("bad line %u", uline));
-
-    vector<string> path;
-    while (ss >> token1) path.push_back(std::move(token1));
-    
-    // input...
-    uline += 1U;
-    if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
-    ss.clear();
-    ss.str(string_line);
-    ss >> token1;
-    if (token1 != "input") die(ERR_INT("bad line %u", uline));
-    
-    vector<float> inputs;
-    float f;
-    while (ss >> f) inputs.push_back(f);
-
-    // value...
-    uline += 1U;
-    if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
-    ss.clear();
-    ss.str(string_line);
-    ss >> token1;
-    if (token1 != "value") die(ERR_INT("bad line %u", uline));
-
-    float value;
-    ss >> value;
-
-    // policy...
-    uline += 1U;
-    if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
-    ss.clear();
-    ss.str(string_line);
-    ss >> token1;
-    if (token1 != "policy") die(ERR_INT("bad line %u", uline));
-
-    policy_t policy;
-    while (ss >> token1 >> f) policy.emplace_back(std::move(token1), f);
-
-    // END
-    uline += 1U;
-    if (! std::getline(ifs, string_line)) die(ERR_INT("bad line %u", uline));
-    if (string_line != "END") die(ERR_INT("bad line %u", uline));
-
-    compare(path, inputs, value, policy, udata); } }
+    compare(e.path, e.inputs, e.value, e.policy, udata); } }
+
+static const string &top1(const policy_t &policy) noexcept {
+  static const string empty;
+  if (policy.empty()) return empty;
+  return std::max_element(policy.begin(), policy.end(),
+			  [](const pair<string, float> &a,
+			     const pair<string, float> &b) {
+			    return a.second < b.second; })->first; }
+
+// Accuracy of a reduced precision network (e.g. aobaz -q8) against FP32.
+// Both files are written by aobaz nndump from the same records.
+static void do_accuracy(const char *fref, const char *ftest) noexcept {
+  std::ifstream ifs_ref(fref);
+  if (!ifs_ref) die(ERR_INT("cannot open %s", fref));
+  std::ifstream ifs_test(ftest);
+  if (!ifs_test) die(ERR_INT("cannot open %s", ftest));
+
+  Entry ref, test;
+  uint uline_ref = 0, uline_test = 0, num = 0, top1_agree = 0;
+  double value_se = 0.0, value_max = 0.0, policy_ae = 0.0, policy_max = 0.0;
+  while (read_entry(ifs_ref, uline_ref, ref)) {
+    if (! read_entry(ifs_test, uline_test, test))
+      die(ERR_INT("%s is shorter than %s", ftest, fref));
+    if (ref.path != test.path)
+      die(ERR_INT("position differs at line %u", uline_test));
+
+    num += 1U;
+    if (top1(ref.policy) == top1(test.policy)) top1_agree += 1U;
+
+    double d = static_cast<double>(ref.value) - test.value;
+    value_se += d * d;
+    value_max = std::max(value_max, std::fabs(d));
+
+    std::sort(ref.policy.begin(), ref.policy.end());
+    std::sort(test.policy.begin(), test.policy.end());
+    if (ref.policy.size() != test.policy.size())
+      die(ERR_INT("legal moves differ at line %u", uline_test));
+    for (uint u = 0; u < ref.policy.size(); ++u) {
+      double e = std::fabs(ref.policy[u].second - test.policy[u].second);
+      policy_ae += e;
+      policy_max = std::max(policy_max, e); } }
+
+  if (num == 0) die(ERR_INT("no positions in %s", fref));
+  cout << "positions          " << num << "\n";
+  cout << std::fixed << std::setprecision(4);
+  cout << "policy top-1 agree " << 100.0 * top1_agree / num << " %\n";
+  cout << "policy L1 distance " << policy_ae / num << "\n";
+  cout << "policy max error   " << policy_max << "\n";
+  cout << "value MSE          " << value_se / num << "\n";
+  cout << "value max error    " << value_max << endl; }
 
 #include <set>
-#include <iomanip>
 static void compare(const vector<string> &path, const vector<float> &inputs,
 		    float value, const policy_t &policy, uint udata) noexcept {
   Node node;
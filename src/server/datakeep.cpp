@@ -33,6 +33,7 @@ constexpr char fname_tmp[]       = "tmp.csa.x_";
 constexpr char fmt_arch[]        = "arch%012" PRIi64 ".csa.xz";
 constexpr char fmt_pool[]        = "no%012" PRIi64 ".csa.xz";
 constexpr char fmt_wght_scn[]    = "w%16[^.].txt.xz";
+constexpr char fmt_wbin_scn[]    = "w%16[^.].bin.xz";
 constexpr char fmt_pool_scn[]    = "no%16[^.].csa.xz";
 const PtrLen<const char> pl_CSAsepa("/\n", 2);
 
@@ -151,8 +152,10 @@ bool WghtKeep::get_crc64(int64_t no, uint64_t &digest) const noexcept {
   return true; }
 
 void WghtKeep::get_new_wght() noexcept {
-  set<FNameID> no;
+  set<FNameID> no, no_bin;
   grab_files(no, _dwght.get_fname(), fmt_wght_scn, _i64_now + 1);
+  grab_files(no_bin, _dwght.get_fname(), fmt_wbin_scn, _i64_now + 1);
+  no.insert(no_bin.begin(), no_bin.end());
   
   for (auto it = no.rbegin(); it != no.rend(); ++it) {
     int fd = open(it->get_fname(), O_RDONLY);
@@ -165,7 +168,10 @@ void WghtKeep::get_new_wght() noexcept {
     if (sb.st_size != read(fd, pl.p, pl.len)) die(ERR_CLL("read"));
     close(fd);
     uint64_t digest;
-    if (! is_weight_ok(pl, digest)) continue;
+    if (! is_weight_ok(pl, digest)) {
+      if (0 <= match_fname(it->get_bname(), fmt_wbin_scn))
+	_logger->out(nullptr, fmt_bad_wght_s, it->get_fname());
+      continue; }
     
     _logger->out(nullptr, fmt_found_wght_s, it->get_fname());
     _i64_now = it->get_id();
@@ -216,6 +222,7 @@ void WghtKeep::start(Logger *logger, const char *dwght, uint wght_poll)
       token = strtok_r(buf, " \t\r", &saveptr);
       if (!token || token[0] == '#') continue;
       int64_t no = match_fname(token, fmt_wght_scn);
+      if (no < 0) no = match_fname(token, fmt_wbin_scn);
       if (no < 0) die(ERR_INT("bad weight name %s", token));
       
       token = strtok_r(nullptr, " \t\r", &saveptr);
@@ -30,6 +30,7 @@ namespace Log {
   constexpr char bad_wght_crc64_ull[] = "bad weight crc64 %" PRIu64 ")";
   constexpr char load_list_s[]        = "loading list: %s";
   constexpr char fmt_found_wght_s[]   = "found new weight %s";
+  constexpr char fmt_bad_wght_s[]     = "bad weight %s ignored";
   constexpr char fmt_bad_cmd_s[]      = "closed due to bad command (%s)";
   constexpr char fmt_multiple_cmd_s[] = "closed due to multiple commands (%s)";
   constexpr char fmt_reset_s[]        = "closed due to reset by peer (%s)";
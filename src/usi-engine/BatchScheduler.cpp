@@ -0,0 +1,178 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "config.h"
+#include "BatchScheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+    // weight of a new sample in the moving averages
+    constexpr auto ewma_weight = 1.0 / 8.0;
+    // upper bound of the first latency bucket, doubled for each next one
+    constexpr auto first_bucket_us = 500.0;
+    // waits are never shorter, so a worker does not spin
+    constexpr auto min_wait_us = 100.0;
+}
+
+void BatchScheduler::initialize(const size_t max_batch, const int latency_cap_ms) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_max_batch = std::max(max_batch, size_t{1});
+    m_cap_us = std::max(latency_cap_ms, 0) * 1000.0;
+    m_target = m_max_batch;
+    m_wait_us = INITIAL_WAIT_US;
+    m_batches.assign(m_max_batch + 1, 0);
+    m_latency_us.assign(m_max_batch + 1, 0.0);
+    m_latency_hist.fill(0);
+    m_evals = 0;
+    m_busy_us = 0.0;
+    m_since_retune = 0;
+    m_retunes = 0;
+    m_arrivals = 0;
+    m_interarrival_us = 0.0;
+}
+
+std::chrono::microseconds BatchScheduler::wait_time(const size_t queued) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::chrono::microseconds(static_cast<long long>(wait_us(queued)));
+}
+
+double BatchScheduler::wait_us(const size_t queued) const {
+    const auto target = m_target.load();
+    auto us = static_cast<double>(m_wait_us);
+    if (m_arrivals >= 2 && queued < target) {
+        // twice the expected time, and never below the old 1 ms minimum, as
+        // positions come in bursts from forward_batch()
+        const auto fill = 2.0 * (target - queued) * m_interarrival_us;
+        us = std::min(us, std::max(fill, 1000.0));
+    }
+    if (m_cap_us > 0.0 && m_batches[target] > 0) {
+        us = std::min(us, m_cap_us - m_latency_us[target]);
+    }
+    return std::max(us, min_wait_us);
+}
+
+void BatchScheduler::arrival() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto now = clock::now();
+    if (m_arrivals > 0) {
+        // a pause of the search is not a slow arrival
+        const auto us = std::min(
+            std::chrono::duration<double, std::micro>(now - m_last_arrival).count(),
+            static_cast<double>(INITIAL_WAIT_US));
+        if (m_arrivals == 1) {
+            m_interarrival_us = us;
+        } else {
+            m_interarrival_us += (us - m_interarrival_us) * ewma_weight;
+        }
+    }
+    m_last_arrival = now;
+    m_arrivals++;
+}
+
+void BatchScheduler::record(const size_t size, const clock::duration latency) {
+    if (size == 0) {
+        return;
+    }
+    const auto us = std::chrono::duration<double, std::micro>(latency).count();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    // nnbench and the callers of forward_batch() may exceed -b
+    if (size >= m_batches.size()) {
+        m_batches.resize(size + 1, 0);
+        m_latency_us.resize(size + 1, 0.0);
+    }
+    if (m_batches[size]++ == 0) {
+        m_latency_us[size] = us;
+    } else {
+        m_latency_us[size] += (us - m_latency_us[size]) * ewma_weight;
+    }
+    auto bucket = 0;
+    for (auto bound = first_bucket_us;
+         bucket < LATENCY_BUCKETS - 1 && us > bound; bound *= 2.0) {
+        bucket++;
+    }
+    m_latency_hist[bucket]++;
+    m_evals += size;
+    m_busy_us += us;
+
+    if (m_cap_us > 0.0 && ++m_since_retune >= RETUNE_BATCHES) {
+        m_since_retune = 0;
+        retune();
+    }
+}
+
+void BatchScheduler::timed_out() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_wait_us > 1000) {
+        m_wait_us -= 1000;
+    }
+}
+
+void BatchScheduler::single_eval_too_early() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_wait_us += 2000;
+}
+
+bool BatchScheduler::within_cap(const size_t size) const {
+    return m_batches[size] > 0 && m_latency_us[size] <= m_cap_us;
+}
+
+double BatchScheduler::evals_per_sec(const size_t size) const {
+    return size * 1e6 / std::max(m_latency_us[size], 1.0);
+}
+
+void BatchScheduler::retune() {
+    const auto t = m_target.load();
+    if (m_batches[t] == 0) {
+        // no batch of the target size yet, nothing to compare
+        return;
+    }
+    auto next = t;
+    if (!within_cap(t)) {
+        next = std::max(t - 1, size_t{1});
+    } else if (t < m_max_batch
+               && (m_batches[t + 1] == 0 || ++m_retunes % EXPLORE_RETUNES == 0)) {
+        next = t + 1;
+    } else if (t < m_max_batch && within_cap(t + 1)
+               && evals_per_sec(t + 1) > evals_per_sec(t)) {
+        next = t + 1;
+    } else if (t > 1 && within_cap(t - 1)
+               && evals_per_sec(t - 1) > evals_per_sec(t)) {
+        next = t - 1;
+    }
+    m_target = next;
+}
+
+std::string BatchScheduler::stats() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    char buf[64];
+    std::snprintf(buf, sizeof(buf), "target %zu wait %.1f evals_per_sec %.1f",
+                  m_target.load(), wait_us(0) / 1000.0,
+                  m_busy_us > 0.0 ? m_evals * 1e6 / m_busy_us : 0.0);
+    auto str = std::string(buf);
+    str += " size";
+    for (auto size = size_t{1}; size < m_batches.size(); size++) {
+        if (m_batches[size] > 0) {
+            std::snprintf(buf, sizeof(buf), " %zu:%llu", size,
+                          static_cast<unsigned long long>(m_batches[size]));
+            str += buf;
+        }
+    }
+    str += " latency_ms";
+    auto bound = first_bucket_us;
+    for (auto bucket = 0; bucket < LATENCY_BUCKETS; bucket++, bound *= 2.0) {
+        if (m_latency_hist[bucket] == 0) {
+            continue;
+        }
+        if (bucket < LATENCY_BUCKETS - 1) {
+            std::snprintf(buf, sizeof(buf), " %g:%llu", bound / 1000.0,
+                          static_cast<unsigned long long>(m_latency_hist[bucket]));
+        } else {
+            std::snprintf(buf, sizeof(buf), " inf:%llu",
+                          static_cast<unsigned long long>(m_latency_hist[bucket]));
+        }
+        str += buf;
+    }
+    return str;
+}
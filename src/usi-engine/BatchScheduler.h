@@ -0,0 +1,95 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef BATCHSCHEDULER_H_INCLUDED
+#define BATCHSCHEDULER_H_INCLUDED
+#include "config.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Chooses the size of the batches a pipe runs and how long to wait for
+// one, from the latency of the batches run so far and the arrivals of
+// positions. The best values differ by device, network and number of
+// search threads, so they are measured instead of set.
+//
+// Each batch size keeps a moving average of its latency. With a latency
+// cap, every RETUNE_BATCHES batches the target moves to a neighbouring
+// size if that gives more evals/s within the cap, and now and then tries
+// the next larger size again. Without a cap the target stays at the
+// largest size, so the search forms the same batches as with a fixed -b.
+//
+// The wait for a full batch is the shortest of the time the arrivals need
+// to fill it, what the cap leaves after the batch itself, and a bound
+// kept as OpenCLScheduler always did: 1 ms shorter after each wait that
+// ended in a single eval, 2 ms longer when positions arrived during one.
+// The bound stops a wait for positions that never come because they
+// depend on the evals waiting.
+//
+// All members are thread safe.
+class BatchScheduler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // latency_cap_ms 0: no cap, the target is max_batch
+    void initialize(size_t max_batch, int latency_cap_ms);
+
+    size_t max_batch() const { return m_max_batch; }
+    size_t target() const { return m_target.load(); }
+    // how long to wait for target() when queued positions are waiting
+    std::chrono::microseconds wait_time(size_t queued) const;
+
+    // a position was queued
+    void arrival();
+    // a batch of size positions took latency
+    void record(size_t size, clock::duration latency);
+    // the wait ended in a single eval
+    void timed_out();
+    // positions arrived while a single eval was running
+    void single_eval_too_early();
+
+    // target, wait (ms), evals/s and histograms of the batch sizes and of
+    // the latencies (count per upper bound in ms), e.g.
+    // "target 4 wait 1.0 evals_per_sec 2345.6 size 1:12 4:300 latency_ms 1:12 4:300"
+    std::string stats() const;
+
+private:
+    static constexpr auto RETUNE_BATCHES = 32;
+    // try the next larger size again every this many retunes
+    static constexpr auto EXPLORE_RETUNES = 8;
+    // the first bound, and the longest gap taken as an arrival interval
+    static constexpr auto INITIAL_WAIT_US = 10000;
+    // 0.5, 1, 2, ... 128 ms and above
+    static constexpr auto LATENCY_BUCKETS = 10;
+
+    // the members below need m_mutex
+    double wait_us(size_t queued) const;
+    bool within_cap(size_t size) const;
+    double evals_per_sec(size_t size) const;
+    void retune();
+
+    mutable std::mutex m_mutex;
+    size_t m_max_batch{1};
+    double m_cap_us{0.0};
+    std::atomic<size_t> m_target{1};
+    int m_wait_us{INITIAL_WAIT_US};
+
+    // indexed by batch size
+    std::vector<std::uint64_t> m_batches;
+    std::vector<double> m_latency_us;
+    std::array<std::uint64_t, LATENCY_BUCKETS> m_latency_hist{};
+    std::uint64_t m_evals{0};
+    double m_busy_us{0.0};
+    int m_since_retune{0};
+    int m_retunes{0};
+
+    clock::time_point m_last_arrival;
+    std::uint64_t m_arrivals{0};
+    double m_interarrival_us{0.0};
+};
+
+#endif
@@ -0,0 +1,222 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "config.h"
+#include "CPUGemm.h"
+#include "CPUKernels.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEMM_X86
+#define GEMM_TARGET(isa) __attribute__((target(isa)))
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define GEMM_X86
+#define GEMM_TARGET(isa)
+#endif
+
+#ifdef GEMM_X86
+#include <immintrin.h>
+#endif
+
+using CPUGemm::PBLOCK;
+
+namespace {
+    // One panel of KR output channels times all of P.
+    // M points at the first channel of the panel, rows of M are K apart.
+    using PanelFunc = void (*)(const float *Up, const float *V, float *M,
+                               const int C, const int K, const int P,
+                               const int rows);
+
+    struct Kernel {
+        const char *name;
+        int kr;
+        PanelFunc panel;
+    };
+
+    template <int KR>
+    void store_block(const float (&acc)[PBLOCK][KR], float *M,
+                     const int K, const int p0, const int rows) {
+        for (auto i = 0; i < PBLOCK; i++) {
+            for (auto j = 0; j < rows; j++) {
+                M[(p0 + i)*K + j] = acc[i][j];
+            }
+        }
+    }
+
+#ifndef GEMM_X86
+    void panel_generic(const float *Up, const float *V, float *M,
+                       const int C, const int K, const int P,
+                       const int rows) {
+        constexpr auto KR = 8;
+        for (auto p0 = 0; p0 < P; p0 += PBLOCK) {
+            float acc[PBLOCK][KR] = {};
+            for (auto c = 0; c < C; c++) {
+                const auto w = Up + c*KR;
+                const auto v = V + p0*C + c;
+                for (auto i = 0; i < PBLOCK; i++) {
+                    for (auto j = 0; j < KR; j++) {
+                        acc[i][j] += w[j] * v[i*C];
+                    }
+                }
+            }
+            store_block<KR>(acc, M, K, p0, rows);
+        }
+    }
+#else
+    void panel_sse(const float *Up, const float *V, float *M,
+                   const int C, const int K, const int P,
+                   const int rows) {
+        constexpr auto KR = 4;
+        for (auto p0 = 0; p0 < P; p0 += PBLOCK) {
+            __m128 acc[PBLOCK];
+            for (auto i = 0; i < PBLOCK; i++) {
+                acc[i] = _mm_setzero_ps();
+            }
+            for (auto c = 0; c < C; c++) {
+                const auto w = _mm_loadu_ps(Up + c*KR);
+                const auto v = V + p0*C + c;
+                for (auto i = 0; i < PBLOCK; i++) {
+                    acc[i] = _mm_add_ps(acc[i], _mm_mul_ps(w, _mm_set1_ps(v[i*C])));
+                }
+            }
+            if (rows == KR) {
+                for (auto i = 0; i < PBLOCK; i++) {
+                    _mm_storeu_ps(M + (p0 + i)*K, acc[i]);
+                }
+                continue;
+            }
+            float out[PBLOCK][KR];
+            for (auto i = 0; i < PBLOCK; i++) {
+                _mm_storeu_ps(out[i], acc[i]);
+            }
+            store_block<KR>(out, M, K, p0, rows);
+        }
+    }
+
+    GEMM_TARGET("avx2,fma")
+    void panel_avx2(const float *Up, const float *V, float *M,
+                    const int C, const int K, const int P,
+                    const int rows) {
+        constexpr auto KR = 8;
+        for (auto p0 = 0; p0 < P; p0 += PBLOCK) {
+            __m256 acc[PBLOCK];
+            for (auto i = 0; i < PBLOCK; i++) {
+                acc[i] = _mm256_setzero_ps();
+            }
+            for (auto c = 0; c < C; c++) {
+                const auto w = _mm256_loadu_ps(Up + c*KR);
+                const auto v = V + p0*C + c;
+                for (auto i = 0; i < PBLOCK; i++) {
+                    acc[i] = _mm256_fmadd_ps(w, _mm256_set1_ps(v[i*C]), acc[i]);
+                }
+            }
+            if (rows == KR) {
+                for (auto i = 0; i < PBLOCK; i++) {
+                    _mm256_storeu_ps(M + (p0 + i)*K, acc[i]);
+                }
+                continue;
+            }
+            float out[PBLOCK][KR];
+            for (auto i = 0; i < PBLOCK; i++) {
+                _mm256_storeu_ps(out[i], acc[i]);
+            }
+            store_block<KR>(out, M, K, p0, rows);
+        }
+    }
+
+    GEMM_TARGET("avx512f")
+    void panel_avx512(const float *Up, const float *V, float *M,
+                      const int C, const int K, const int P,
+                      const int rows) {
+        constexpr auto KR = 16;
+        for (auto p0 = 0; p0 < P; p0 += PBLOCK) {
+            __m512 acc[PBLOCK];
+            for (auto i = 0; i < PBLOCK; i++) {
+                acc[i] = _mm512_setzero_ps();
+            }
+            for (auto c = 0; c < C; c++) {
+                const auto w = _mm512_loadu_ps(Up + c*KR);
+                const auto v = V + p0*C + c;
+                for (auto i = 0; i < PBLOCK; i++) {
+                    acc[i] = _mm512_fmadd_ps(w, _mm512_set1_ps(v[i*C]), acc[i]);
+                }
+            }
+            if (rows == KR) {
+                for (auto i = 0; i < PBLOCK; i++) {
+                    _mm512_storeu_ps(M + (p0 + i)*K, acc[i]);
+                }
+                continue;
+            }
+            float out[PBLOCK][KR];
+            for (auto i = 0; i < PBLOCK; i++) {
+                _mm512_storeu_ps(out[i], acc[i]);
+            }
+            store_block<KR>(out, M, K, p0, rows);
+        }
+    }
+#endif
+
+    Kernel select_kernel() {
+#ifdef GEMM_X86
+        const auto& f = CPUKernels::features();
+        if (f.avx512f) {
+            return {"AVX-512", 16, panel_avx512};
+        }
+        if (f.avx2 && f.fma) {
+            return {"AVX2", 8, panel_avx2};
+        }
+        return {"SSE", 4, panel_sse};
+#else
+        return {"generic", 8, panel_generic};
+#endif
+    }
+
+    const Kernel& kernel() {
+        static const auto k = select_kernel();
+        return k;
+    }
+
+    int padded(const int K) {
+        const auto kr = kernel().kr;
+        return (K + kr - 1) / kr * kr;
+    }
+}
+
+const char *CPUGemm::isa_name() {
+    return kernel().name;
+}
+
+int CPUGemm::panel_width() {
+    return kernel().kr;
+}
+
+size_t CPUGemm::packed_size(const int C, const int K) {
+    return static_cast<size_t>(padded(K)) * C;
+}
+
+std::vector<float> CPUGemm::pack(const std::vector<float>& U,
+                                 const int C, const int K) {
+    const auto KR = panel_width();
+    const auto stride = packed_size(C, K);
+    const auto tiles = U.size() / (C * K);
+    auto ret = std::vector<float>(tiles * stride, 0.0f);
+
+    for (auto b = size_t{0}; b < tiles; b++) {
+        for (auto c = 0; c < C; c++) {
+            for (auto k = 0; k < K; k++) {
+                ret[b*stride + (k/KR)*C*KR + c*KR + k%KR] = U[b*C*K + c*K + k];
+            }
+        }
+    }
+    return ret;
+}
+
+void CPUGemm::sgemm(const float *U, const float *V, float *M,
+                    const int C, const int K, const int P) {
+    assert(P % PBLOCK == 0);
+    const auto& k = kernel();
+    for (auto k0 = 0; k0 < K; k0 += k.kr) {
+        k.panel(U + k0*C, V, M + k0, C, K, P, std::min(k.kr, K - k0));
+    }
+}
@@ -0,0 +1,39 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef CPUGEMM_H_INCLUDED
+#define CPUGEMM_H_INCLUDED
+#include "config.h"
+
+#include <cstddef>
+#include <vector>
+
+// Small SGEMM for the CPU Winograd convolutions and the 1x1 heads,
+// M[p][k] = sum_c V[p][c] * U[c][k], one call per Winograd tile element.
+// V and M are channel-interleaved like the activations of CPUPipe.
+//
+// BLAS is tuned for large matrices, but here K and C are the channel
+// count and P is 9 tiles per position. U is packed once at load into
+// panels of panel_width() output channels, [K/KR][C][KR] with K padded
+// by zeros, so a micro-kernel streams one contiguous panel while KR x 9
+// accumulators stay in registers. P must be a multiple of 9.
+//
+// The kernel (SSE, AVX2 or AVX-512) is chosen once at startup from the
+// CPU (CPUKernels::features()), not from the compiler flags.
+namespace CPUGemm {
+    constexpr auto PBLOCK = 9;
+
+    const char *isa_name();
+    int panel_width();
+
+    // size of one packed tile element
+    size_t packed_size(const int C, const int K);
+
+    // [tiles][C][K] -> [tiles][K/KR][C][KR]
+    std::vector<float> pack(const std::vector<float>& U, const int C, const int K);
+
+    // one tile element. U is packed, V is [P][C], M is [P][K].
+    void sgemm(const float *U, const float *V, float *M,
+               const int C, const int K, const int P);
+}
+
+#endif
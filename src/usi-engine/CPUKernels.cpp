@@ -0,0 +1,128 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "config.h"
+#include "CPUKernels.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KERNELS_X86
+#include <cpuid.h>
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define KERNELS_X86
+#include <intrin.h>
+#endif
+
+namespace {
+#ifdef KERNELS_X86
+    struct Regs {
+        unsigned int eax, ebx, ecx, edx;
+    };
+
+    Regs cpuid(const unsigned int leaf, const unsigned int subleaf) {
+        auto r = Regs{0, 0, 0, 0};
+#ifdef _MSC_VER
+        int v[4];
+        __cpuidex(v, leaf, subleaf);
+        r = {static_cast<unsigned int>(v[0]), static_cast<unsigned int>(v[1]),
+             static_cast<unsigned int>(v[2]), static_cast<unsigned int>(v[3])};
+#else
+        __cpuid_count(leaf, subleaf, r.eax, r.ebx, r.ecx, r.edx);
+#endif
+        return r;
+    }
+
+    // register state the OS saves on a context switch
+    unsigned long long xcr0() {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int eax, edx;
+        __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+    }
+
+    bool bit(const unsigned int reg, const int n) {
+        return ((reg >> n) & 1) != 0;
+    }
+#endif
+
+    CPUKernels::Features detect() {
+        auto f = CPUKernels::Features{};
+#ifdef KERNELS_X86
+        const auto max_leaf = cpuid(0, 0).eax;
+        if (max_leaf < 1) {
+            return f;
+        }
+        const auto l1 = cpuid(1, 0);
+        // AVX needs the OS to save the YMM registers, AVX-512 also the
+        // opmask and ZMM registers.
+        const auto osxsave = bit(l1.ecx, 27);
+        const auto xcr = osxsave ? xcr0() : 0;
+        const auto os_avx = (xcr & 0x06) == 0x06;
+        const auto os_avx512 = (xcr & 0xe6) == 0xe6;
+        f.avx = os_avx && bit(l1.ecx, 28);
+        f.fma = f.avx && bit(l1.ecx, 12);
+        f.f16c = f.avx && bit(l1.ecx, 29);
+        if (max_leaf < 7) {
+            return f;
+        }
+        const auto l7 = cpuid(7, 0);
+        f.avx2 = f.avx && bit(l7.ebx, 5);
+        f.avx512f = os_avx512 && bit(l7.ebx, 16);
+        f.avx512vl = f.avx512f && bit(l7.ebx, 31);
+        f.avx512vnni = f.avx512f && bit(l7.ecx, 11);
+        if (l7.eax >= 1) {
+            const auto l71 = cpuid(7, 1);
+            f.avxvnni = f.avx2 && bit(l71.eax, 4);
+            f.avx512bf16 = f.avx512f && bit(l71.eax, 5);
+        }
+#endif
+        return f;
+    }
+
+    CPUKernels::Features& mutable_features() {
+        static auto f = detect();
+        return f;
+    }
+
+    const CPUKernels::Table *const s_tables[] = {
+        &CPUKernels::avx512bf16, &CPUKernels::avx512,
+        &CPUKernels::avx2, &CPUKernels::baseline
+    };
+}
+
+const CPUKernels::Features& CPUKernels::features() {
+    return mutable_features();
+}
+
+bool CPUKernels::limit(const std::string& level) {
+    auto& f = mutable_features();
+    if (level == "avx512bf16") {
+        return true;
+    }
+    if (level == "avx512") {
+        f.avx512bf16 = false;
+        return true;
+    }
+    if (level == "avx2") {
+        f.avx512f = f.avx512vl = f.avx512bf16 = f.avx512vnni = false;
+        return true;
+    }
+    if (level == "sse2" || level == "generic") {
+        f = Features{};
+        return true;
+    }
+    return false;
+}
+
+const CPUKernels::Table& CPUKernels::get() {
+    static const auto table = [] {
+        for (const auto t : s_tables) {
+            if (t->supported(features())) {
+                return t;
+            }
+        }
+        return &baseline;
+    }();
+    return *table;
+}
@@ -0,0 +1,74 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef CPUKERNELS_H_INCLUDED
+#define CPUKERNELS_H_INCLUDED
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+
+// The SIMD kernels of CPUPipe, built from CPUKernels.inc once per x86 ISA
+// level in CPUKernels_<level>.cpp with the compiler flags of that level
+// (see the Makefile). The best level the CPU runs is chosen once at
+// startup by cpuid, so one binary built for the baseline ISA is as fast
+// as a -march=native build on new CPUs and still runs on old ones.
+//
+// CPUGemm and CPUPipeInt8 select their kernels from features() as well.
+namespace CPUKernels {
+    // of the running CPU and enabled by the OS, all false off x86
+    struct Features {
+        bool avx{false};
+        bool avx2{false};
+        bool fma{false};
+        bool f16c{false};
+        bool avx512f{false};
+        bool avx512vl{false};
+        bool avx512bf16{false};
+        bool avx512vnni{false};
+        bool avxvnni{false};
+    };
+    const Features& features();
+    // Caps the features at a level, "sse2" (or "generic"), "avx2",
+    // "avx512" or "avx512bf16", before the first kernel is chosen.
+    // false for an unknown level.
+    bool limit(const std::string& level);
+
+    // Winograd input and output transforms (CPUPipe.h) of the channels
+    // [begin, end) of all tiles of batch_size positions. simd false runs
+    // the scalar reference of CPUPipe::verify_transforms().
+    using TransformIn = void (*)(const float *in, float *V, int C,
+                                 int batch_size, int begin, int end,
+                                 bool simd);
+    using TransformOut = void (*)(const float *M, float *Y, const float *bias,
+                                  const float *residual, int K,
+                                  int batch_size, int begin, int end,
+                                  bool simd);
+    // One tile element of CPUPipe::winograd_sgemm16(). scratch holds
+    // P * C / 2 values for the BF16 activations of native BF16 kernels.
+    using Sgemm16 = void (*)(const std::uint16_t *U, const float *V, float *M,
+                             int C, int K, int P, std::uint32_t *scratch);
+
+    struct Table {
+        const char *name;
+        int simd_width;
+        // the CPU has everything the level was compiled for
+        bool (*supported)(const Features& f);
+        TransformIn transform_in4;
+        TransformOut transform_out4;
+        TransformIn transform_in3;
+        TransformOut transform_out3;
+        Sgemm16 sgemm_fp16;
+        Sgemm16 sgemm_bf16;
+    };
+
+    // one per level, best first
+    extern const Table avx512bf16;
+    extern const Table avx512;
+    extern const Table avx2;
+    extern const Table baseline;
+
+    // the best of them for this CPU
+    const Table& get();
+}
+
+#endif
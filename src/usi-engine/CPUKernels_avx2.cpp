@@ -0,0 +1,5 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+// CPUKernels for AVX2, FMA and F16C (Haswell, Zen and later)
+#define CPU_KERNELS_TABLE avx2
+#include "CPUKernels.inc"
@@ -0,0 +1,5 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+// CPUKernels for AVX-512F on top of the AVX2 level (Skylake-SP and later)
+#define CPU_KERNELS_TABLE avx512
+#include "CPUKernels.inc"
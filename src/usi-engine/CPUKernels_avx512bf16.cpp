@@ -0,0 +1,6 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+// CPUKernels for AVX-512 BF16 on top of the AVX-512 level (Cooper Lake,
+// Sapphire Rapids, Zen 4 and later)
+#define CPU_KERNELS_TABLE avx512bf16
+#include "CPUKernels.inc"
@@ -0,0 +1,5 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+// CPUKernels for any CPU, built with the flags of the other files
+#define CPU_KERNELS_TABLE baseline
+#include "CPUKernels.inc"
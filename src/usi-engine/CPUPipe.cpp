@@ -42,9 +42,19 @@
 #include <Eigen/Dense>
 #endif
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <string>
+
 #include "CPUPipe.h"
+#include "CPUGemm.h"
 #include "Network.h"
 #include "Im2Col.h"
+#include "Utils.h"
+#include "half/half.hpp"
 
 #ifndef USE_BLAS
 // Eigen helpers
@@ -56,248 +66,355 @@ using ConstEigenMatrixMap =
     Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic>>;
 #endif
 
-void CPUPipe::initialize(int channels) {
-    m_input_channels = channels;
-}
-
-void CPUPipe::winograd_transform_in(const std::vector<float>& in,
-                                    std::vector<float>& V,
-                                    const int C) {
-    constexpr auto W = BOARD_SIZE;
-    constexpr auto H = BOARD_SIZE;
-    constexpr auto WTILES = WINOGRAD_WTILES;
-    constexpr auto P = WINOGRAD_P;
+namespace {
+    // 16-bit weight storage for winograd_sgemm16()
+    std::uint16_t to_bf16(float f) {
+        std::uint32_t u;
+        std::memcpy(&u, &f, sizeof(u));
+        u += 0x7fff + ((u >> 16) & 1);      // round to nearest even
+        return static_cast<std::uint16_t>(u >> 16);
+    }
 
-    constexpr auto Wpad = 2 + WINOGRAD_M * WTILES;
+    // [tile][C][K] -> FP16, same layout
+    std::vector<std::uint16_t> pack_fp16(const std::vector<float>& U) {
+        auto ret = std::vector<std::uint16_t>(U.size());
+        for (auto i = size_t{0}; i < U.size(); i++) {
+            ret[i] = half_float::detail::float2half<std::round_to_nearest>(U[i]);
+        }
+        return ret;
+    }
 
-    constexpr auto buffersize = 32;
+    // [tile][C][K] -> BF16 [tile][C/2][K][2], so that a 32-bit lane holds
+    // the weights of two input channels as AVX512-BF16 dot products want.
+    std::vector<std::uint16_t> pack_bf16(const std::vector<float>& U,
+                                         const int C, const int K) {
+        assert(C % 2 == 0);
+        auto ret = std::vector<std::uint16_t>(U.size());
+        const auto tiles = U.size() / (C * K);
+        for (auto b = size_t{0}; b < tiles; b++) {
+            for (auto c = 0; c < C; c++) {
+                for (auto k = 0; k < K; k++) {
+                    ret[b*C*K + (c/2)*K*2 + k*2 + (c&1)] = to_bf16(U[b*C*K + c*K + k]);
+                }
+            }
+        }
+        return ret;
+    }
+}
 
-    std::array<std::array<float, Wpad>, Wpad> in_pad{0.0f};
+void CPUPipe::initialize(int channels) {
+    m_input_channels = channels;
 
-    std::array<float, buffersize * WINOGRAD_ALPHA * WINOGRAD_ALPHA> buffer;
-    auto buffer_offset = 0;
-    auto buffer_entries = 0;
+    m_kernels = &CPUKernels::get();
+    Utils::myprintf("CPU kernels: %s (%d-wide transforms), %s GEMM.\n",
+             m_kernels->name, m_kernels->simd_width, CPUGemm::isa_name());
+
+    // Workers are pinned to cfg_cpu_affinity + 1, 2, ... The calling
+    // search thread takes the first part of every split.
+    m_threads = std::max(cfg_cpu_threads, 1);
+    m_pool = std::make_unique<Utils::ThreadPool>();
+    for (auto i = 1; i < m_threads; i++) {
+        const auto cpu = (cfg_cpu_affinity >= 0) ? cfg_cpu_affinity + i : -1;
+        m_pool->add_thread([cpu] {
+            if (cpu >= 0 && !Utils::set_thread_affinity(cpu)) {
+                Utils::myprintf("Could not pin CPU worker to CPU %d.\n", cpu);
+            }
+        });
+    }
+    if (m_threads > 1) {
+        Utils::myprintf("CPU forward with %d threads%s.\n", m_threads,
+                 cfg_cpu_affinity >= 0 ? ", pinned" : "");
+    }
 
+    // Scalar and SIMD do the same operations in the same order, so
+    // anything but rounding noise means a broken build.
+    constexpr auto max_error = 1e-5f;
+    m_simd_transforms = true;
+    const auto error = verify_transforms();
+    if (error > max_error) {
+        m_simd_transforms = false;
+        Utils::myprintf("CPU Winograd transforms: %d-wide SIMD differs from scalar by %g, using scalar.\n",
+                 m_kernels->simd_width, error);
+    }
+}
 
-    // multiple vector [i0..i5] by Bt and produce [o0..o5]
-    // const auto Bt = std::array<float, WINOGRAD_TILE>
-    //           {1.0f,  0.0f,     -5.0f/2.0f,  0.0f,      1.0f, 0.0f,
-    //            0.0f, -SQ2,      -2.0f,       SQ2/2.0f,  1.0f, 0.0f,
-    //            0.0f,  SQ2,      -2.0f,      -SQ2/2.0f,  1.0f, 0.0f,
-    //            0.0f, -SQ2/2.0f, -1.0f/2.0f,  SQ2,       1.0f, 0.0f,
-    //            0.0f,  SQ2/2.0f, -1.0f/2.0f, -SQ2,       1.0f, 0.0f,
-    //            0.0f,  1.0f,      0.0f,      -5.0f/2.0f, 0.0f, 1.0f};
-    auto multiply_bt = [](
-        float & o0, float & o1, float & o2, float & o3, float & o4, float & o5,
-        float i0, float i1, float i2, float i3, float i4, float i5
-    ) {
-        auto i3m1 = i1 * -SQ2 + i3 * (SQ2 / 2.0f);
-        auto i4m2 = i2 * -2.0f + i4 * 1.0f;
+CPUPipe::Workspace& CPUPipe::get_workspace() {
+    static thread_local Workspace s_workspace;
+    return s_workspace;
+}
 
-        o0 = i0 + i2 * (-5.0f/2.0f) + i4;
-        o1 = i3m1 + i4m2;
-        o2 = -i3m1 + i4m2;
+void CPUPipe::winograd_transform_in(const std::vector<float>& in,
+                                    std::vector<float>& V,
+                                    const int C,
+                                    const int batch_size) {
+    parallel_for(C, m_kernels->simd_width, [&](const int begin, const int end) {
+        m_kernels->transform_in4(in.data(), V.data(), C, batch_size,
+                                 begin, end, m_simd_transforms);
+    });
+}
 
-        auto i3m1_2 = i3 * (SQ2) + i1 * (-SQ2/2.0f);
-        auto i4m2_2 = i2 * (-1.0f/2.0f) + i4;
+void CPUPipe::winograd_sgemm(const WeightArray<float>& U,
+                             const std::vector<float>& V,
+                             std::vector<float>& M,
+                             const int C, const int K,
+                             const int P) {
+    const auto stride = CPUGemm::packed_size(C, K);
+    const auto tiles = static_cast<int>(U.size() / stride);
+
+    parallel_for(tiles, 1, [&](const int begin, const int end) {
+        for (auto b = begin; b < end; b++) {
+            CPUGemm::sgemm(&U[b * stride], &V[b * C * P], &M[b * K * P], C, K, P);
+        }
+    });
+}
 
-        o3 = i3m1_2 + i4m2_2;
-        o4 = -i3m1_2 + i4m2_2;
+void CPUPipe::winograd_sgemm16(const WeightArray<std::uint16_t>& U,
+                               const std::vector<float>& V,
+                               std::vector<float>& M,
+                               const int C, const int K,
+                               const int P) {
+    assert(P % WINOGRAD_P == 0);
+    const auto tiles = static_cast<int>(U.size()) / (K * C);
+    const auto bf16 = (m_precision == cpu_precision_t::BFLOAT16);
+    const auto sgemm = bf16 ? m_kernels->sgemm_bf16 : m_kernels->sgemm_fp16;
+
+    parallel_for(tiles, 1, [&](const int begin, const int end) {
+        // BF16 activations of native BF16 kernels, one buffer per part as
+        // each part runs on its own thread
+        auto& scratch = get_workspace().sgemm_scratch;
+        const auto scratch_size = static_cast<size_t>(bf16 ? P * C/2 : 0);
+        if (scratch.size() < scratch_size) {
+            scratch.resize(scratch_size);
+        }
+        for (auto b = begin; b < end; b++) {
+            sgemm(&U[b * K * C], &V[b * C * P], &M[b * K * P], C, K, P,
+                  scratch.data());
+        }
+    });
+}
 
-        o5 = i1 + i3 * (-5.0f/2.0f) + i5;
-    };
+void CPUPipe::winograd_transform_out(const std::vector<float>& M,
+                                     std::vector<float>& Y,
+                                     const int K,
+                                     const int batch_size,
+                                     const float *bias,
+                                     const std::vector<float>* residual) {
+    parallel_for(K, m_kernels->simd_width, [&](const int begin, const int end) {
+        m_kernels->transform_out4(M.data(), Y.data(), bias,
+                                  residual ? residual->data() : nullptr,
+                                  K, batch_size, begin, end, m_simd_transforms);
+    });
+}
 
-    for (auto ch = 0; ch < C; ch++) {
-        for (auto yin = 0; yin < H; yin++) {
-            for (auto xin = 0; xin < W; xin++) {
-                in_pad[yin + 1][xin + 1] = in[ch*(W*H) + yin*W + xin];
-            }
-        }
-        for (auto block_y = 0; block_y < WTILES; block_y++) {
-            // Tiles overlap by 2
-            const auto yin = WINOGRAD_M * block_y;
-            for (auto block_x = 0; block_x < WTILES; block_x++) {
-                const auto xin = WINOGRAD_M * block_x;
-#define DECL_T1(XX) \
-                float T1_##XX##_0, T1_##XX##_1, T1_##XX##_2, T1_##XX##_3, T1_##XX##_4, T1_##XX##_5;
-                DECL_T1(0)
-                DECL_T1(1)
-                DECL_T1(2)
-                DECL_T1(3)
-                DECL_T1(4)
-                DECL_T1(5)
-
-                // Calculates transpose(B).x.B
-#define MULTIPLY_BT(XX) \
-                multiply_bt( \
-                    T1_0_##XX, T1_1_##XX, T1_2_##XX, T1_3_##XX, T1_4_##XX, T1_5_##XX, \
-                    in_pad[yin + 0][xin + XX], \
-                    in_pad[yin + 1][xin + XX], \
-                    in_pad[yin + 2][xin + XX], \
-                    in_pad[yin + 3][xin + XX], \
-                    in_pad[yin + 4][xin + XX], \
-                    in_pad[yin + 5][xin + XX] \
-                );
-                MULTIPLY_BT(0)
-                MULTIPLY_BT(1)
-                MULTIPLY_BT(2)
-                MULTIPLY_BT(3)
-                MULTIPLY_BT(4)
-                MULTIPLY_BT(5)
-
-#define MULTIPLY_B(XX) \
-                multiply_bt( \
-                    buffer[buffersize * (XX * WINOGRAD_ALPHA + 0) + buffer_entries], \
-                    buffer[buffersize * (XX * WINOGRAD_ALPHA + 1) + buffer_entries], \
-                    buffer[buffersize * (XX * WINOGRAD_ALPHA + 2) + buffer_entries], \
-                    buffer[buffersize * (XX * WINOGRAD_ALPHA + 3) + buffer_entries], \
-                    buffer[buffersize * (XX * WINOGRAD_ALPHA + 4) + buffer_entries], \
-                    buffer[buffersize * (XX * WINOGRAD_ALPHA + 5) + buffer_entries], \
-                    T1_##XX##_0, T1_##XX##_1, T1_##XX##_2, T1_##XX##_3, T1_##XX##_4, T1_##XX##_5 \
-                );
-                MULTIPLY_B(0)
-                MULTIPLY_B(1)
-                MULTIPLY_B(2)
-                MULTIPLY_B(3)
-                MULTIPLY_B(4)
-                MULTIPLY_B(5)
-
-                if (buffer_entries == 0) {
-                    buffer_offset = ch * P + block_y * WTILES + block_x;
+std::vector<float> CPUPipe::winograd3_transform_f(const std::vector<float>& f,
+                                                  const int outputs,
+                                                  const int channels) {
+    // F(3x3, 3x3) Winograd filter transformation, points 0, 1, -1, 2, inf
+    // Same layout as Network::winograd_transform_f()
+    constexpr auto ALPHA = WINOGRAD3_ALPHA;
+    auto U = std::vector<float>(WINOGRAD3_TILE * outputs * channels);
+    const auto G = std::array<float, 3 * ALPHA>
+                    { 1.0f/2.0f,   0.0f,       0.0f,
+                      -1.0f/2.0f, -1.0f/2.0f, -1.0f/2.0f,
+                      -1.0f/6.0f,  1.0f/6.0f, -1.0f/6.0f,
+                      1.0f/6.0f,   1.0f/3.0f,  2.0f/3.0f,
+                      0.0f,        0.0f,       1.0f};
+
+    auto temp = std::array<float, 3 * ALPHA>{};
+
+    for (auto o = 0; o < outputs; o++) {
+        for (auto c = 0; c < channels; c++) {
+            for (auto i = 0; i < ALPHA; i++) {
+                for (auto j = 0; j < 3; j++) {
+                    auto acc = 0.0f;
+                    for (auto k = 0; k < 3; k++) {
+                        acc += G[i*3 + k] * f[o*channels*9 + c*9 + k*3 + j];
+                    }
+                    temp[i*3 + j] = acc;
                 }
-                buffer_entries++;
-
-                if (buffer_entries >= buffersize ||
-                    (ch == C - 1 && block_x == WTILES - 1 && block_y == WTILES - 1)) {
+            }
 
-                    for (auto i = 0; i < WINOGRAD_ALPHA * WINOGRAD_ALPHA; i++) {
-                        for (auto entry = 0; entry < buffer_entries; entry++) {
-                            V[i*C*P + buffer_offset + entry] = buffer[i*buffersize + entry];
-                        }
+            for (auto xi = 0; xi < ALPHA; xi++) {
+                for (auto nu = 0; nu < ALPHA; nu++) {
+                    auto acc = 0.0f;
+                    for (auto k = 0; k < 3; k++) {
+                        acc += temp[xi*3 + k] * G[nu*3 + k];
                     }
-                    buffer_entries = 0;
+                    U[xi * (ALPHA * outputs * channels)
+                      + nu * (outputs * channels)
+                      + c * outputs
+                      + o] = acc;
                 }
             }
         }
     }
-}
 
-void CPUPipe::winograd_sgemm(const std::vector<float>& U,
-                             const std::vector<float>& V,
-                             std::vector<float>& M,
-                             const int C, const int K) {
-    constexpr auto P = WINOGRAD_P;
+    return U;
+}
 
-    for (auto b = 0; b < WINOGRAD_TILE; b++) {
-        const auto offset_u = b * K * C;
-        const auto offset_v = b * C * P;
-        const auto offset_m = b * K * P;
-#ifdef USE_BLAS
-        cblas_sgemm(CblasRowMajor, CblasTrans, CblasNoTrans,
-                    K, P, C,
-                    1.0f,
-                    &U[offset_u], K,
-                    &V[offset_v], P,
-                    0.0f,
-                    &M[offset_m], P);
-#else
-        auto C_mat = EigenMatrixMap<float>(M.data() + offset_m, P, K);
-        C_mat.noalias() =
-           ConstEigenMatrixMap<float>(V.data() + offset_v, P, C)
-            * ConstEigenMatrixMap<float>(U.data() + offset_u, K, C).transpose();
-#endif
-    }
+void CPUPipe::winograd3_transform_in(const std::vector<float>& in,
+                                     std::vector<float>& V,
+                                     const int C,
+                                     const int batch_size) {
+    parallel_for(C, m_kernels->simd_width, [&](const int begin, const int end) {
+        m_kernels->transform_in3(in.data(), V.data(), C, batch_size,
+                                 begin, end, m_simd_transforms);
+    });
 }
 
-void CPUPipe::winograd_transform_out(const std::vector<float>& M,
-                                     std::vector<float>& Y,
-                                     const int K) {
-    constexpr auto W = BOARD_SIZE;
-    constexpr auto H = BOARD_SIZE;
-    constexpr auto WTILES = WINOGRAD_WTILES;
-    constexpr auto P = WINOGRAD_P;
+void CPUPipe::winograd3_transform_out(const std::vector<float>& M,
+                                      std::vector<float>& Y,
+                                      const int K,
+                                      const int batch_size,
+                                      const float *bias,
+                                      const std::vector<float>* residual) {
+    // The tiles cover the board exactly, the bounds check never fails
+    parallel_for(K, m_kernels->simd_width, [&](const int begin, const int end) {
+        m_kernels->transform_out3(M.data(), Y.data(), bias,
+                                  residual ? residual->data() : nullptr,
+                                  K, batch_size, begin, end, m_simd_transforms);
+    });
+}
 
-    // multiple vector [i0..i5] by At and produce [o0..o3]
-    // const auto At = std::array<float, WINOGRAD_ALPHA * WINOGRAD_M>
-    //       {1.0f, 1.0f,      1.0f,       1.0f,      1.0f,     0.0f,
-    //        0.0f, SQ2/2.0f, -SQ2/2.0f,   SQ2,      -SQ2,      0.0f,
-    //        0.0f, 1.0f/2.0f, 1.0f/2.0f,  2.0f,      2.0f,     0.0f,
-    //        0.0f, SQ2/4.0f, -SQ2/4.0f,   2.0f*SQ2, -2.0f*SQ2, 1.0f};
-    auto multiply_at = [](
-        float & o0, float & o1, float & o2, float & o3,
-        float i0, float i1, float i2, float i3, float i4, float i5
-    ) {
-        auto t1p2 = (i1 + i2) * (1.0f / 2.0f);
-        auto t1m2 = (i1 - i2) * (SQ2/4.0f);
-        auto t3p4 = i3 + i4;
-        auto t3m4 = (i3 - i4) * (SQ2);
-
-        o0 = i0 + t1p2 + t1p2 + t3p4;
-        o1 = t1m2 + t1m2 + t3m4;
-        o2 = t1p2 + t3p4 + t3p4;
-        o3 = t1m2 + t3m4 + t3m4 + i5;
+void CPUPipe::winograd_convolve3(const int outputs,
+                                 const std::vector<float>& input,
+                                 const size_t layer,
+                                 const std::vector<float>* residual,
+                                 std::vector<float>& V,
+                                 std::vector<float>& M,
+                                 std::vector<float>& output,
+                                 const int batch_size) {
+
+    const auto input_channels = (layer == 0) ? Network::INPUT_CHANNELS
+                                             : m_input_channels;
+    const auto bias = m_weights.biases[layer].data();
+    auto sgemm = [&](const std::vector<WeightArray<float>>& U, const int P) {
+        if (m_precision == cpu_precision_t::SINGLE) {
+            winograd_sgemm(U[layer], V, M, input_channels, outputs, P);
+        } else {
+            winograd_sgemm16(m_weights.conv16[layer], V, M, input_channels, outputs, P);
+        }
     };
 
-    for (auto k = 0; k < K; k++) {
-        for (auto block_x = 0; block_x < WTILES; block_x++) {
-            const auto x = WINOGRAD_M * block_x;
-            for (auto block_y = 0; block_y < WTILES; block_y++) {
-                const auto y = WINOGRAD_M * block_y;
-
-                const auto b = block_y * WTILES + block_x;
-                using WinogradTile =
-                    std::array<std::array<float, WINOGRAD_ALPHA>, WINOGRAD_ALPHA>;
-                WinogradTile temp_m;
-                for (auto xi = 0; xi < WINOGRAD_ALPHA; xi++) {
-                    for (auto nu = 0; nu < WINOGRAD_ALPHA; nu++) {
-                        temp_m[xi][nu] =
-                            M[(xi*WINOGRAD_ALPHA + nu)*K*P + k*P + b];
-                    }
+    if (m_winograd_m == WINOGRAD3_M) {
+        winograd3_transform_in(input, V, input_channels, batch_size);
+        sgemm(m_weights.conv3, WINOGRAD3_P * batch_size);
+        winograd3_transform_out(M, output, outputs, batch_size, bias, residual);
+        return;
+    }
+
+    winograd_transform_in(input, V, input_channels, batch_size);
+    sgemm(m_weights.conv, WINOGRAD_P * batch_size);
+    winograd_transform_out(M, output, outputs, batch_size, bias, residual);
+}
+
+bool CPUPipe::input_convolve_sparse(const std::vector<float>& input,
+                                    std::vector<float>& output,
+                                    const int batch_size,
+                                    Workspace& ws) {
+    constexpr auto C = Network::INPUT_CHANNELS;
+    constexpr auto N = NUM_INTERSECTIONS;
+    const auto K = m_input_channels;
+    if (m_weights.input_sparse.empty()) {
+        return false;
+    }
+
+    // Most planes are one-hot pieces of the last 8 positions, the rest
+    // (hands, repetition, side to move, move count) are constant. A
+    // constant plane adds a per-square-kind bias, every other nonzero
+    // point adds its 3x3 weight slices to the 9 squares around it.
+    auto& points = ws.points;
+    auto& planes = ws.planes;
+    if (points.size() < static_cast<size_t>(batch_size)) {
+        points.resize(batch_size);
+        planes.resize(batch_size);
+    }
+    for (auto b = 0; b < batch_size; b++) {
+        points[b].clear();
+        planes[b].clear();
+        for (auto c = 0; c < C; c++) {
+            const auto plane = &input[(b * C + c) * N];
+            if (std::all_of(plane + 1, plane + N,
+                            [&](const float v) { return v == plane[0]; })) {
+                if (plane[0] != 0.0f) {
+                    planes[b].push_back({c, 0, plane[0]});
                 }
-                std::array<std::array<float, WINOGRAD_ALPHA>, WINOGRAD_M> temp;
-                std::array<std::array<float, WINOGRAD_M>, WINOGRAD_M> o;
-
-                // Calculates transpose(A).temp_m.A
-                for (auto j = 0; j < WINOGRAD_ALPHA; j++){
-                    multiply_at(
-                        temp[0][j], temp[1][j], temp[2][j], temp[3][j],
-                        temp_m[0][j], temp_m[1][j], temp_m[2][j], temp_m[3][j], temp_m[4][j], temp_m[5][j]
-                    );
+                continue;
+            }
+            for (auto i = 0; i < N; i++) {
+                if (plane[i] != 0.0f) {
+                    points[b].push_back({c, i, plane[i]});
                 }
+            }
+        }
+        // 9 MACs per point against 25 * 9 per input channel in F(3x3, 3x3).
+        // The scattered adds run far below GEMM speed, so stay well under
+        // that break-even. Real positions have a few hundred points.
+        if (points[b].size() > static_cast<size_t>(C * N / 32)) {
+            return false;
+        }
+    }
 
-                for (auto i = 0; i < WINOGRAD_M; i++){
-                    multiply_at(
-                        o[i][0], o[i][1], o[i][2], o[i][3],
-                        temp[i][0], temp[i][1], temp[i][2], temp[i][3], temp[i][4], temp[i][5]
-                    );
+    const auto& bias = m_weights.biases[0];
+    auto square_kind = [](const int y, const int x) {
+        auto kind = [](const int i) { return (i == 0) ? 0 : (i == BOARD_SIZE - 1) ? 2 : 1; };
+        return kind(y) * 3 + kind(x);
+    };
+    // Each part writes only its own channels of plane_bias.
+    auto& plane_bias = ws.plane_bias;
+    plane_bias.resize(9 * K);
+    parallel_for(K, m_kernels->simd_width, [&](const int k0, const int k1) {
+        for (auto b = 0; b < batch_size; b++) {
+            const auto out = &output[b * N * K];
+            for (auto s = 0; s < 9; s++) {
+                for (auto k = k0; k < k1; k++) {
+                    plane_bias[s * K + k] = bias[k];
+                }
+                for (const auto& p : planes[b]) {
+                    const auto w = &m_weights.input_const[(p.c * 9 + s) * K];
+                    for (auto k = k0; k < k1; k++) {
+                        plane_bias[s * K + k] += p.value * w[k];
+                    }
+                }
+            }
+            for (auto y = 0; y < BOARD_SIZE; y++) {
+                for (auto x = 0; x < BOARD_SIZE; x++) {
+                    const auto pb = &plane_bias[square_kind(y, x) * K];
+                    std::copy(pb + k0, pb + k1, out + (y * BOARD_SIZE + x) * K + k0);
                 }
+            }
 
-                const auto y_ind = k * H * W + y * W + x;
-                for (auto i = 0; i < WINOGRAD_M; i++) {
-                    for (auto j = 0; j < WINOGRAD_M; j++) {
-                        if (y + i < H && x + j < W) {
-                            Y[y_ind + i * W + j] = o[i][j];
+            // Output (y, x) sees input (y + dy - 1, x + dx - 1).
+            for (const auto& p : points[b]) {
+                const auto iy = p.square / BOARD_SIZE;
+                const auto ix = p.square % BOARD_SIZE;
+                for (auto dy = 0; dy < 3; dy++) {
+                    const auto y = iy - dy + 1;
+                    if (y < 0 || y >= BOARD_SIZE) {
+                        continue;
+                    }
+                    for (auto dx = 0; dx < 3; dx++) {
+                        const auto x = ix - dx + 1;
+                        if (x < 0 || x >= BOARD_SIZE) {
+                            continue;
+                        }
+                        const auto w = &m_weights.input_sparse[(p.c * 9 + dy * 3 + dx) * K];
+                        const auto o = out + (y * BOARD_SIZE + x) * K;
+                        for (auto k = k0; k < k1; k++) {
+                            o[k] += p.value * w[k];
                         }
                     }
                 }
             }
-        }
-    }
-}
-
-void CPUPipe::winograd_convolve3(const int outputs,
-                                 const std::vector<float>& input,
-                                 const std::vector<float>& U,
-                                 std::vector<float>& V,
-                                 std::vector<float>& M,
-                                 std::vector<float>& output) {
 
-    constexpr unsigned int filter_len = WINOGRAD_ALPHA * WINOGRAD_ALPHA;
-    const auto input_channels = U.size() / (outputs * filter_len);
-
-    winograd_transform_in(input, V, input_channels);
-    winograd_sgemm(U, V, M, input_channels, outputs);
-    winograd_transform_out(M, output, outputs);
+            for (auto i = 0; i < N; i++) {
+                for (auto k = k0; k < k1; k++) {
+                    out[i * K + k] = std::max(out[i * K + k], 0.0f);
+                }
+            }
+        }
+    });
+    return true;
 }
 
 template<unsigned int filter_size>
@@ -315,7 +432,10 @@ void convolve(const size_t outputs,
     const auto filter_dim = filter_len * input_channels;
     assert(outputs * num_intersections == output.size());
 
-    std::vector<float> col(filter_dim * width * height);
+    // im2col writes every element, the padding too, so the buffer is
+    // reused by each thread.
+    static thread_local std::vector<float> col;
+    col.resize(filter_dim * width * height);
     im2col<filter_size>(input_channels, input, col);
 
     // Weight shape (output, input, filter_size, filter_size)
@@ -351,38 +471,59 @@ void convolve(const size_t outputs,
     }
 }
 
-template <size_t spatial_size>
-void batchnorm(const size_t channels,
-               std::vector<float>& data,
-               const float* const means,
-               const float* const stddevs,
-               const float* const eltwise = nullptr) {
-    const auto lambda_ReLU = [](const auto val) { return (val > 0.0f) ?
-                                                          val : 0.0f; };
-    for (auto c = size_t{0}; c < channels; ++c) {
-        const auto mean = means[c];
-        const auto scale_stddev = stddevs[c];
-        const auto arr = &data[c * spatial_size];
-
-        if (eltwise == nullptr) {
-            // Classical BN
-            for (auto b = size_t{0}; b < spatial_size; b++) {
-                arr[b] = lambda_ReLU(scale_stddev * (arr[b] - mean));
-            }
-        } else {
-            // BN + residual add
-            const auto res = &eltwise[c * spatial_size];
-            for (auto b = size_t{0}; b < spatial_size; b++) {
-                arr[b] = lambda_ReLU((scale_stddev * (arr[b] - mean)) + res[b]);
-            }
-        }
-    }
-}
+// Used by CPUPipeInt8 (FP32 layers and heads).
+template void convolve<1>(const size_t outputs,
+                          const std::vector<float>& input,
+                          const std::vector<float>& weights,
+                          const std::vector<float>& biases,
+                          std::vector<float>& output);
+template void convolve<3>(const size_t outputs,
+                          const std::vector<float>& input,
+                          const std::vector<float>& weights,
+                          const std::vector<float>& biases,
+                          std::vector<float>& output);
 
 void CPUPipe::forward(const std::vector<float>& input,
                       std::vector<float>& output_pol,
                       std::vector<float>& output_val) {
-    // Input convolution
+    forward_batch(input, output_pol, output_val, 1);
+}
+
+void CPUPipe::forward_batch(const std::vector<float>& input,
+                            std::vector<float>& output_pol,
+                            std::vector<float>& output_val,
+                            const size_t batch_size) {
+    const auto batch = static_cast<int>(batch_size);
+    const auto conv_size = m_input_channels * NUM_INTERSECTIONS;
+    auto& ws = get_workspace();
+    auto& conv_out = ws.conv_out;
+    conv_out.resize(conv_size * batch_size);
+    input_convolve(input, conv_out, batch, ws);
+
+    // Residual tower
+    auto& V = ws.V;
+    auto& M = ws.M;
+    auto& conv_in = ws.conv_in;
+    auto& res = ws.res;
+    conv_in.resize(conv_size * batch_size);
+    res.resize(conv_size * batch_size);
+    for (auto i = size_t{1}; i < m_weights.biases.size(); i += 2) {
+        auto output_channels = m_input_channels;
+        std::swap(conv_out, conv_in);
+        winograd_convolve3(output_channels, conv_in, i, nullptr, V, M, conv_out, batch);
+
+        std::swap(conv_in, res);
+        std::swap(conv_out, conv_in);
+        winograd_convolve3(output_channels, conv_in, i + 1, &res, V, M, conv_out, batch);
+    }
+
+    convolve_heads(conv_out, output_pol, output_val, batch, ws);
+}
+
+void CPUPipe::input_convolve(const std::vector<float>& input,
+                             std::vector<float>& output,
+                             const int batch_size,
+                             Workspace& ws) {
     constexpr auto P = WINOGRAD_P;
     // Calculate output channels
     const auto output_channels = m_input_channels;
@@ -391,39 +532,55 @@ void CPUPipe::forward(const std::vector<float>& input,
     // might be bigger when the network has very few filters
     const auto input_channels = std::max(static_cast<size_t>(output_channels),
                                          static_cast<size_t>(Network::INPUT_CHANNELS));
-    auto conv_out = std::vector<float>(output_channels * NUM_INTERSECTIONS);
-
-    auto V = std::vector<float>(WINOGRAD_TILE * input_channels * P);
-    auto M = std::vector<float>(WINOGRAD_TILE * output_channels * P);
-
-    winograd_convolve3(output_channels, input, m_weights->m_conv_weights[0], V, M, conv_out);
-    batchnorm<NUM_INTERSECTIONS>(output_channels, conv_out,
-                                 m_weights->m_batchnorm_means[0].data(),
-                                 m_weights->m_batchnorm_stddevs[0].data());
 
-    // Residual tower
-    auto conv_in = std::vector<float>(output_channels * NUM_INTERSECTIONS);
-    auto res = std::vector<float>(output_channels * NUM_INTERSECTIONS);
-    for (auto i = size_t{1}; i < m_weights->m_conv_weights.size(); i += 2) {
-        auto output_channels = m_input_channels;
-        std::swap(conv_out, conv_in);
-        winograd_convolve3(output_channels, conv_in,
-                           m_weights->m_conv_weights[i], V, M, conv_out);
-        batchnorm<NUM_INTERSECTIONS>(output_channels, conv_out,
-                                     m_weights->m_batchnorm_means[i].data(),
-                                     m_weights->m_batchnorm_stddevs[i].data());
+    // F(4x4, 3x3) needs the larger buffers, so they fit either tiling.
+    auto& V = ws.V;
+    auto& M = ws.M;
+    V.resize(WINOGRAD_TILE * input_channels * P * batch_size);
+    M.resize(WINOGRAD_TILE * output_channels * P * batch_size);
+
+    // The tower works channel-interleaved, [position][81][channels].
+    if (!input_convolve_sparse(input, output, batch_size, ws)) {
+        constexpr auto in_channels = Network::INPUT_CHANNELS;
+        auto& input_hwc = ws.input_hwc;
+        input_hwc.resize(input.size());
+        for (auto b = 0; b < batch_size; b++) {
+            const auto offset = b * in_channels * NUM_INTERSECTIONS;
+            for (auto c = 0; c < in_channels; c++) {
+                for (auto i = 0; i < NUM_INTERSECTIONS; i++) {
+                    input_hwc[offset + i * in_channels + c] = input[offset + c * NUM_INTERSECTIONS + i];
+                }
+            }
+        }
+        winograd_convolve3(output_channels, input_hwc, 0, nullptr, V, M, output, batch_size);
+    }
+}
 
-        std::swap(conv_in, res);
-        std::swap(conv_out, conv_in);
-        winograd_convolve3(output_channels, conv_in,
-                           m_weights->m_conv_weights[i + 1], V, M, conv_out);
-        batchnorm<NUM_INTERSECTIONS>(output_channels, conv_out,
-                                     m_weights->m_batchnorm_means[i + 1].data(),
-                                     m_weights->m_batchnorm_stddevs[i + 1].data(),
-                                     res.data());
-    }
-    convolve<1>(Network::OUTPUTS_POLICY, conv_out, m_conv_pol_w, m_conv_pol_b, output_pol);
-    convolve<1>(Network::OUTPUTS_VALUE, conv_out, m_conv_val_w, m_conv_val_b, output_val);
+void CPUPipe::convolve_heads(const std::vector<float>& input,
+                             std::vector<float>& output_pol,
+                             std::vector<float>& output_val,
+                             const int batch_size,
+                             Workspace& ws) {
+    // 1x1 heads, the 81 points of one position are P of one GEMM.
+    // The outputs go back to [channels][81].
+    const auto conv_size = m_input_channels * NUM_INTERSECTIONS;
+    auto head = [&](const WeightArray<float>& w, const int outputs,
+                    std::vector<float>& output) {
+        const auto size = outputs * NUM_INTERSECTIONS;
+        auto& out_hwc = ws.head;
+        out_hwc.resize(size);
+        for (auto b = 0; b < batch_size; b++) {
+            CPUGemm::sgemm(w.data(), &input[b * conv_size], out_hwc.data(),
+                           m_input_channels, outputs, NUM_INTERSECTIONS);
+            for (auto i = 0; i < NUM_INTERSECTIONS; i++) {
+                for (auto k = 0; k < outputs; k++) {
+                    output[b * size + k * NUM_INTERSECTIONS + i] = out_hwc[i * outputs + k];
+                }
+            }
+        }
+    };
+    head(m_weights.pol, Network::OUTPUTS_POLICY, output_pol);
+    head(m_weights.val, Network::OUTPUTS_VALUE, output_val);
 }
 
 void CPUPipe::push_weights(unsigned int /*filter_size*/,
@@ -431,12 +588,332 @@ void CPUPipe::push_weights(unsigned int /*filter_size*/,
                            unsigned int outputs,
                            std::shared_ptr<const ForwardPipeWeights> weights) {
 
-    m_weights = weights;
+    if (push_cached_weights(weights->m_crc64)) {
+        return;
+    }
+    // Another engine may have been writing it
+    WeightCache::Lock lock(*m_cache);
+    if (push_cached_weights(weights->m_crc64)) {
+        return;
+    }
+
+    // Fold batchnorm into the filters and biases once here, so the tower
+    // needs no separate pass over the activations:
+    // stddev * (conv(x, w) - mean) = conv(x, stddev * w) - stddev * mean
+    // U is laid out with the output channel innermost, see winograd_sgemm.
+    auto fold_batchnorm = [](std::vector<float>& U, const std::vector<float>& stddevs) {
+        const auto outputs = stddevs.size();
+        for (auto i = size_t{0}; i < U.size(); i++) {
+            U[i] *= stddevs[i % outputs];
+        }
+    };
+
+    const auto layers = weights->m_conv_weights.size();
+    m_conv_weights = weights->m_conv_weights;
+    m_conv_biases.clear();
+    for (auto i = size_t{0}; i < layers; i++) {
+        const auto& means = weights->m_batchnorm_means[i];
+        const auto& stddevs = weights->m_batchnorm_stddevs[i];
+        fold_batchnorm(m_conv_weights[i], stddevs);
+        auto bias = std::vector<float>(means.size());
+        for (auto k = size_t{0}; k < means.size(); k++) {
+            bias[k] = -stddevs[k] * means[k];
+        }
+        m_conv_biases.emplace_back(std::move(bias));
+    }
+
+    // Output head convolutions, [outputs][channels] -> [channels][outputs]
+    auto pack_head = [&](const std::vector<float>& w) {
+        const auto K = static_cast<int>(w.size() / outputs);
+        auto U = std::vector<float>(w.size());
+        for (auto k = 0; k < K; k++) {
+            for (auto c = size_t{0}; c < outputs; c++) {
+                U[c * K + k] = w[k * outputs + c];
+            }
+        }
+        return CPUGemm::pack(U, outputs, K);
+    };
+    m_conv_pol_w = pack_head(weights->m_conv_pol_w);
+    m_conv_val_w = pack_head(weights->m_conv_val_w);
+
+    // Input convolution as weight slices, [K][C][3][3] -> [C][3x3][K].
+    // m_input_const sums the taps that stay on the board, see
+    // input_convolve_sparse().
+    {
+        constexpr auto C = Network::INPUT_CHANNELS;
+        const auto K = m_input_channels;
+        const auto& w = weights->m_conv_weights_3x3[0];
+        const auto& stddevs = weights->m_batchnorm_stddevs[0];
+        m_input_sparse.assign(C * 9 * K, 0.0f);
+        m_input_const.assign(C * 9 * K, 0.0f);
+        for (auto k = 0; k < K; k++) {
+            for (auto c = 0; c < C; c++) {
+                for (auto t = 0; t < 9; t++) {
+                    m_input_sparse[(c * 9 + t) * K + k] = stddevs[k] * w[(k * C + c) * 9 + t];
+                }
+            }
+        }
+        // kind 0 is the first row or column, 2 the last: there dy = 0 or
+        // dy = 2 (dx alike) falls off the board.
+        for (auto c = 0; c < C; c++) {
+            for (auto s = 0; s < 9; s++) {
+                const auto ky = s / 3;
+                const auto kx = s % 3;
+                for (auto t = 0; t < 9; t++) {
+                    const auto dy = t / 3;
+                    const auto dx = t % 3;
+                    if ((ky == 0 && dy == 0) || (ky == 2 && dy == 2)
+                        || (kx == 0 && dx == 0) || (kx == 2 && dx == 2)) {
+                        continue;
+                    }
+                    for (auto k = 0; k < K; k++) {
+                        m_input_const[(c * 9 + s) * K + k] += m_input_sparse[(c * 9 + t) * K + k];
+                    }
+                }
+            }
+        }
+    }
+
+    // F(3x3, 3x3) does less transform and GEMM work, but whether it wins
+    // depends on the channel count. Time both and keep the faster one.
+    m_conv_weights3.clear();
+    const auto& raw = weights->m_conv_weights_3x3;
+    for (auto i = size_t{0}; i < raw.size(); i++) {
+        const auto channels = (i == 0) ? Network::INPUT_CHANNELS : m_input_channels;
+        m_conv_weights3.emplace_back(
+            winograd3_transform_f(raw[i], m_input_channels, channels));
+        fold_batchnorm(m_conv_weights3.back(), weights->m_batchnorm_stddevs[i]);
+    }
+    if (m_conv_weights3.size() != layers) {
+        m_conv_weights3.clear();
+    }
 
-    // Output head convolutions
-    m_conv_pol_w = weights->m_conv_pol_w;
-    m_conv_pol_b.resize(m_conv_pol_w.size() / outputs, 0.0f);
-    m_conv_val_w = weights->m_conv_val_w;
-    m_conv_val_b.resize(m_conv_val_w.size() / outputs, 0.0f);
+    // 16-bit copies are made from the plain [tile][C][K] layout, before
+    // the FP32 filters are packed into GEMM panels.
+    auto narrow = [&](const std::vector<std::vector<float>>& filters) {
+        auto ret = std::vector<std::vector<std::uint16_t>>{};
+        for (auto i = size_t{0}; i < filters.size(); i++) {
+            const auto channels = (i == 0) ? Network::INPUT_CHANNELS : m_input_channels;
+            if (cfg_cpu_precision == cpu_precision_t::BFLOAT16) {
+                ret.emplace_back(pack_bf16(filters[i], channels, m_input_channels));
+            } else {
+                ret.emplace_back(pack_fp16(filters[i]));
+            }
+        }
+        return ret;
+    };
+    auto conv_weights16 = std::vector<std::vector<std::uint16_t>>{};
+    auto conv_weights16_3 = std::vector<std::vector<std::uint16_t>>{};
+    if (cfg_cpu_precision != cpu_precision_t::SINGLE) {
+        conv_weights16 = narrow(m_conv_weights);
+        conv_weights16_3 = narrow(m_conv_weights3);
+    }
+    for (auto filters : {&m_conv_weights, &m_conv_weights3}) {
+        for (auto i = size_t{0}; i < filters->size(); i++) {
+            const auto channels = (i == 0) ? Network::INPUT_CHANNELS : m_input_channels;
+            (*filters)[i] = CPUGemm::pack((*filters)[i], channels, m_input_channels);
+        }
+    }
+
+    // The tiling is timed with the FP32 filters.
+    m_precision = cpu_precision_t::SINGLE;
+    m_winograd_m = WINOGRAD_M;
+    bind_weights();
+    if (!m_conv_weights3.empty()) {
+        constexpr auto iterations = 3;
+        const auto time4 = benchmark_forward(iterations);
+        m_winograd_m = WINOGRAD3_M;
+        const auto time3 = benchmark_forward(iterations);
+        if (time3 > time4) {
+            m_winograd_m = WINOGRAD_M;
+            m_conv_weights3.clear();
+            m_conv_weights3.shrink_to_fit();
+        } else {
+            m_conv_weights.clear();
+            m_conv_weights.shrink_to_fit();
+        }
+        Utils::myprintf("CPU Winograd F(4x4,3x3) %.2f ms, F(3x3,3x3) %.2f ms, using F(%dx%d,3x3), %s GEMM, %d-wide transforms.\n",
+                 time4, time3, m_winograd_m, m_winograd_m, CPUGemm::isa_name(),
+                 m_simd_transforms ? m_kernels->simd_width : 1);
+    }
+
+    // Keep only a 16-bit copy of the chosen filters. This halves the
+    // weight memory and the weight traffic of every forward pass.
+    m_conv_weights16.clear();
+    if (cfg_cpu_precision != cpu_precision_t::SINGLE) {
+        m_conv_weights16 = std::move((m_winograd_m == WINOGRAD3_M) ? conv_weights16_3
+                                                                   : conv_weights16);
+        m_conv_weights.clear();
+        m_conv_weights.shrink_to_fit();
+        m_conv_weights3.clear();
+        m_conv_weights3.shrink_to_fit();
+        m_precision = cfg_cpu_precision;
+        Utils::myprintf("CPU Winograd filters stored in %s.\n",
+                 m_precision == cpu_precision_t::BFLOAT16 ? "BF16" : "FP16");
+    }
+    bind_weights();
+    if (!m_cache->enabled()) {
+        return;
+    }
+
+    // Run on the file just written, as the engines started after this
+    // one will, so that this one does not keep a private copy.
+    store_cache(*m_cache);
+    if (m_cache->load() && load_cache(*m_cache)) {
+        m_conv_weights = {};
+        m_conv_weights3 = {};
+        m_conv_weights16 = {};
+        m_conv_biases = {};
+        m_input_sparse = {};
+        m_input_const = {};
+        m_conv_pol_w = {};
+        m_conv_val_w = {};
+        Utils::myprintf("CPU weights mapped from cache %s.\n",
+                 m_cache->filename().c_str());
+    } else {
+        bind_weights();
+    }
 }
 
+bool CPUPipe::push_cached_weights(const std::uint64_t crc64) {
+    // The tiling is chosen by benchmark, so a cached result holds for
+    // this ISA and thread count only.
+    const auto precision_name = [] {
+        switch (cfg_cpu_precision) {
+            case cpu_precision_t::HALF: return "fp16";
+            case cpu_precision_t::BFLOAT16: return "bf16";
+            default: return "fp32";
+        }
+    }();
+    m_cache = std::make_unique<WeightCache>(
+        cfg_weight_cache, crc64,
+        std::string("cpu-") + precision_name + "-"
+        + CPUGemm::isa_name() + "-t" + std::to_string(m_threads));
+    if (!m_cache->load() || !load_cache(*m_cache)) {
+        return false;
+    }
+    Utils::myprintf("CPU weights mapped from cache %s, using F(%dx%d,3x3).\n",
+             m_cache->filename().c_str(), m_winograd_m, m_winograd_m);
+    return true;
+}
+
+void CPUPipe::bind_weights() {
+    auto bind = [](const auto& vv, auto& va) {
+        va.assign(vv.begin(), vv.end());
+    };
+    bind(m_conv_weights, m_weights.conv);
+    bind(m_conv_weights3, m_weights.conv3);
+    bind(m_conv_weights16, m_weights.conv16);
+    bind(m_conv_biases, m_weights.biases);
+    m_weights.input_sparse = m_input_sparse;
+    m_weights.input_const = m_input_const;
+    m_weights.pol = m_conv_pol_w;
+    m_weights.val = m_conv_val_w;
+}
+
+// Only the filters of the chosen tiling and precision go to the cache.
+void CPUPipe::store_cache(WeightCache& cache) {
+    const auto config = std::vector<std::int32_t>{
+        m_winograd_m, static_cast<std::int32_t>(m_precision)};
+    cache.add(config);
+    cache.add(m_conv_weights);
+    cache.add(m_conv_weights3);
+    cache.add(m_conv_weights16);
+    cache.add(m_conv_biases);
+    cache.add(m_input_sparse);
+    cache.add(m_input_const);
+    cache.add(m_conv_pol_w);
+    cache.add(m_conv_val_w);
+    cache.store();
+}
+
+bool CPUPipe::load_cache(WeightCache& cache) {
+    auto config = std::vector<std::int32_t>{};
+    if (!cache.read(config) || config.size() != 2
+        || (config[0] != WINOGRAD_M && config[0] != WINOGRAD3_M)) {
+        return false;
+    }
+    m_winograd_m = config[0];
+    m_precision = static_cast<cpu_precision_t>(config[1]);
+    return cache.view(m_weights.conv)
+        && cache.view(m_weights.conv3)
+        && cache.view(m_weights.conv16)
+        && cache.view(m_weights.biases)
+        && cache.view(m_weights.input_sparse)
+        && cache.view(m_weights.input_const)
+        && cache.view(m_weights.pol)
+        && cache.view(m_weights.val);
+}
+
+double CPUPipe::benchmark_forward(int iterations) {
+    auto input = std::vector<float>(Network::INPUT_CHANNELS * NUM_INTERSECTIONS);
+    for (auto i = size_t{0}; i < input.size(); i++) {
+        input[i] = static_cast<float>((i * 7) % 3 == 0);
+    }
+    auto pol = std::vector<float>(Network::OUTPUTS_POLICY * NUM_INTERSECTIONS);
+    auto val = std::vector<float>(Network::OUTPUTS_VALUE * NUM_INTERSECTIONS);
+
+    // The first run warms up caches and BLAS. Always the FP32 tower,
+    // also in CPUPipeInt8.
+    CPUPipe::forward_batch(input, pol, val, 1);
+    const auto start = std::chrono::steady_clock::now();
+    for (auto i = 0; i < iterations; i++) {
+        CPUPipe::forward_batch(input, pol, val, 1);
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::milli>(elapsed).count() / iterations;
+}
+
+float CPUPipe::verify_transforms() {
+    constexpr auto batch = 2;
+    // The input layer has a channel tail for every SIMD width.
+    const auto C = std::max(m_input_channels, static_cast<int>(Network::INPUT_CHANNELS));
+    const auto K = m_input_channels;
+    const auto P = WINOGRAD_P * batch;
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    auto random = [&](const size_t size) {
+        auto v = std::vector<float>(size);
+        for (auto& x : v) {
+            x = dist(rng);
+        }
+        return v;
+    };
+    const auto in = random(batch * NUM_INTERSECTIONS * C);
+    const auto M = random(WINOGRAD_TILE * P * K);
+    const auto bias = random(K);
+    const auto residual = random(batch * NUM_INTERSECTIONS * K);
+
+    auto max_value = 0.0f;
+    auto max_diff = 0.0f;
+    auto compare = [&](const std::vector<float>& a, const std::vector<float>& b) {
+        for (auto i = size_t{0}; i < a.size(); i++) {
+            max_value = std::max(max_value, std::abs(a[i]));
+            max_diff = std::max(max_diff, std::abs(a[i] - b[i]));
+        }
+    };
+    auto run = [&](std::vector<float> (&V)[2], std::vector<float> (&Y)[2], const bool simd) {
+        m_simd_transforms = simd;
+        winograd_transform_in(in, V[0], C, batch);
+        winograd3_transform_in(in, V[1], C, batch);
+        winograd_transform_out(M, Y[0], K, batch, bias.data(), &residual);
+        winograd3_transform_out(M, Y[1], K, batch, bias.data(), nullptr);
+    };
+
+    std::vector<float> V[2][2];
+    std::vector<float> Y[2][2];
+    for (auto simd = 0; simd < 2; simd++) {
+        for (auto i = 0; i < 2; i++) {
+            V[simd][i].assign(WINOGRAD_TILE * P * C, 0.0f);
+            Y[simd][i].assign(batch * NUM_INTERSECTIONS * K, 0.0f);
+        }
+        run(V[simd], Y[simd], simd != 0);
+    }
+    for (auto i = 0; i < 2; i++) {
+        compare(V[0][i], V[1][i]);
+        compare(Y[0][i], Y[1][i]);
+    }
+    m_simd_transforms = true;
+    return max_value > 0.0f ? max_diff / max_value : max_diff;
+}
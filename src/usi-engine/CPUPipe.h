@@ -33,10 +33,17 @@
 #define CPUPIPE_H_INCLUDED
 #include "config.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <cassert>
 
+#include "CPUKernels.h"
 #include "ForwardPipe.h"
+#include "GTP.h"
+#include "ThreadPool.h"
+#include "WeightCache.h"
 
 class CPUPipe : public ForwardPipe {
 public:
@@ -44,42 +51,207 @@ public:
     virtual void forward(const std::vector<float>& input,
                          std::vector<float>& output_pol,
                          std::vector<float>& output_val);
+    virtual void forward_batch(const std::vector<float>& input,
+                               std::vector<float>& output_pol,
+                               std::vector<float>& output_val,
+                               const size_t batch_size);
 
     virtual void push_weights(unsigned int filter_size,
                               unsigned int channels,
                               unsigned int outputs,
                               std::shared_ptr<const ForwardPipeWeights> weights);
-private:
+
+    // Instead of push_weights(), maps the weights of the weights file of
+    // this CRC64 from the weight cache. false if they are not there.
+    bool push_cached_weights(std::uint64_t crc64);
+protected:
     void winograd_transform_in(const std::vector<float>& in,
                                std::vector<float>& V,
-                               const int C);
+                               const int C,
+                               const int batch_size);
 
-    void winograd_sgemm(const std::vector<float>& U,
+    void winograd_sgemm(const WeightArray<float>& U,
                         const std::vector<float>& V,
                         std::vector<float>& M,
-                        const int C, const int K);
+                        const int C, const int K,
+                        const int P);
+
+    // Same with U in FP16 ([tile][C][K]) or BF16 ([tile][C/2][K][2]),
+    // widened to FP32 in registers. Accumulation is FP32.
+    void winograd_sgemm16(const WeightArray<std::uint16_t>& U,
+                          const std::vector<float>& V,
+                          std::vector<float>& M,
+                          const int C, const int K,
+                          const int P);
 
+    // Y = ReLU(A'MA + bias [+ residual]), batchnorm is folded into U and bias
     void winograd_transform_out(const std::vector<float>& M,
                                 std::vector<float>& Y,
-                                const int K);
+                                const int K,
+                                const int batch_size,
+                                const float *bias,
+                                const std::vector<float>* residual);
+
+    // F(3x3, 3x3) variants. 9 tiles cover the board without padding.
+    static std::vector<float> winograd3_transform_f(const std::vector<float>& f,
+                                                    const int outputs,
+                                                    const int channels);
+
+    void winograd3_transform_in(const std::vector<float>& in,
+                                std::vector<float>& V,
+                                const int C,
+                                const int batch_size);
+
+    void winograd3_transform_out(const std::vector<float>& M,
+                                 std::vector<float>& Y,
+                                 const int K,
+                                 const int batch_size,
+                                 const float *bias,
+                                 const std::vector<float>* residual);
+
+    // f(begin, end) over [0, n) in m_threads parts of a multiple of
+    // align, on the workers and the calling thread
+    template <typename F>
+    void parallel_for(const int n, const int align, F f) {
+        if (m_threads == 1 || n <= align) {
+            f(0, n);
+            return;
+        }
+        auto chunk = (n + m_threads - 1) / m_threads;
+        chunk = (chunk + align - 1) / align * align;
+
+        Utils::ThreadGroup tg(*m_pool);
+        for (auto begin = chunk; begin < n; begin += chunk) {
+            const auto end = std::min(begin + chunk, n);
+            tg.add_task([&f, begin, end] { f(begin, end); });
+        }
+        f(0, std::min(chunk, n));
+        tg.wait_all();
+    }
+
+    double benchmark_forward(int iterations);
+
+    // Everything push_weights() computes, to and from the weight cache.
+    // load_cache() points m_weights into the mapped file.
+    void store_cache(WeightCache& cache);
+    bool load_cache(WeightCache& cache);
+
+    // Points m_weights at the vectors below
+    void bind_weights();
+
+    // Runs the transforms with and without SIMD on random data and
+    // returns the largest difference relative to the largest value.
+    float verify_transforms();
 
     void winograd_convolve3(const int outputs,
                             const std::vector<float>& input,
-                            const std::vector<float>& U,
+                            const size_t layer,
+                            const std::vector<float>* residual,
                             std::vector<float>& V,
                             std::vector<float>& M,
-                            std::vector<float>& output);
+                            std::vector<float>& output,
+                            const int batch_size);
+
+    // A nonzero point, or with square 0 a constant plane, of the input
+    struct InputPoint {
+        int c;
+        int square;
+        float value;
+    };
+
+    // Buffers of one calling thread, kept between calls so a forward pass
+    // allocates nothing once they have grown to the largest batch. Shared
+    // by all CPUPipes, as one thread runs one forward at a time.
+    struct Workspace {
+        std::vector<float> input_hwc;
+        std::vector<float> V;
+        std::vector<float> M;
+        std::vector<float> conv_in;
+        std::vector<float> conv_out;
+        std::vector<float> res;
+        std::vector<float> head;
+        std::vector<float> plane_bias;
+        std::vector<std::vector<InputPoint>> points;
+        std::vector<std::vector<InputPoint>> planes;
+        // winograd_sgemm16() of the part run by this thread, grow-only
+        std::vector<std::uint32_t> sgemm_scratch;
+    };
+    static Workspace& get_workspace();
+
+    // Input convolution from the nonzero points of the [362][81] planes.
+    // Returns false, leaving output undefined, if a position is too dense
+    // for this to beat Winograd.
+    bool input_convolve_sparse(const std::vector<float>& input,
+                               std::vector<float>& output,
+                               const int batch_size,
+                               Workspace& ws);
+
+    // The first and the last part of forward_batch(), around the tower.
+    // Activations are [position][81][channels].
+    void input_convolve(const std::vector<float>& input,
+                        std::vector<float>& output,
+                        const int batch_size,
+                        Workspace& ws);
+    void convolve_heads(const std::vector<float>& input,
+                        std::vector<float>& output_pol,
+                        std::vector<float>& output_val,
+                        const int batch_size,
+                        Workspace& ws);
 
 
     int m_input_channels;
 
-    // Input + residual block tower
-    std::shared_ptr<const ForwardPipeWeights> m_weights;
+    // Winograd output tile size, 4 or 3. Chosen by benchmark in push_weights.
+    int m_winograd_m{4};
+
+    // the transforms and 16-bit GEMM of the best ISA level of the CPU
+    const CPUKernels::Table *m_kernels{nullptr};
+
+    // SIMD across channels in the transforms, off if verify_transforms() fails
+    bool m_simd_transforms{true};
 
+    // Each layer is split across m_threads: the transforms by channels,
+    // the GEMM by Winograd tile element. m_pool has m_threads - 1 workers.
+    int m_threads{1};
+    std::unique_ptr<Utils::ThreadPool> m_pool;
+
+    // Input + residual block tower, batchnorm folded in at push_weights
+    // and packed for CPUGemm
+    std::vector<std::vector<float>> m_conv_weights;     // F(4x4, 3x3)
+    std::vector<std::vector<float>> m_conv_weights3;    // F(3x3, 3x3)
+    std::vector<std::vector<float>> m_conv_biases;
+
+    // With -cpu_prec fp16/bf16 the filters of the chosen tiling are kept
+    // only here, in 16 bits, and the FP32 copies above are freed.
+    cpu_precision_t m_precision{cpu_precision_t::SINGLE};
+    std::vector<std::vector<std::uint16_t>> m_conv_weights16;
+
+    // Input convolution for input_convolve_sparse(), batchnorm folded.
+    // m_input_sparse is [C][3x3][K]. m_input_const is [C][9][K], the
+    // response to a plane of ones at the 9 kinds of square: corner, edge
+    // or inside, as zero padding cuts the filter at the border.
+    std::vector<float> m_input_sparse;
+    std::vector<float> m_input_const;
+
+    // 1x1 heads, packed for CPUGemm
     std::vector<float> m_conv_pol_w;
     std::vector<float> m_conv_val_w;
-    std::vector<float> m_conv_pol_b;
-    std::vector<float> m_conv_val_b;
+
+    // What forward() reads: the vectors above, or with a weight cache
+    // the mapped file, which is shared by every engine of the host that
+    // uses the same file. The vectors are freed then.
+    struct Weights {
+        std::vector<WeightArray<float>> conv;
+        std::vector<WeightArray<float>> conv3;
+        std::vector<WeightArray<std::uint16_t>> conv16;
+        std::vector<WeightArray<float>> biases;
+        WeightArray<float> input_sparse;
+        WeightArray<float> input_const;
+        WeightArray<float> pol;
+        WeightArray<float> val;
+    };
+    Weights m_weights;
+    std::unique_ptr<WeightCache> m_cache;
 };
 
 
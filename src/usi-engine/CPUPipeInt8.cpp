@@ -0,0 +1,535 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "config.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define INT8_X86
+#define INT8_TARGET(isa) __attribute__((target(isa)))
+// AVX-VNNI is known from GCC 11 and clang 12
+#if (defined(__clang__) && __clang_major__ >= 12) \
+    || (!defined(__clang__) && __GNUC__ >= 11)
+#define INT8_AVXVNNI
+#endif
+#elif defined(_MSC_VER) && defined(_M_X64)
+#define INT8_X86
+#define INT8_TARGET(isa)
+#endif
+
+#ifdef INT8_X86
+#include <immintrin.h>
+#endif
+
+#include "CPUKernels.h"
+#include "CPUPipe.h"
+#include "CPUPipeInt8.h"
+#include "Network.h"
+#include "Utils.h"
+
+using namespace Utils;
+
+namespace {
+    constexpr auto INT8_FORMAT_VERSION = 1;
+    constexpr auto QMAX = 127.0f;
+    // outputs of a filter panel, one int32 lane each in a 512-bit register
+    constexpr auto PANEL = 16;
+    // width of the zero-padded input
+    constexpr auto PAD_W = BOARD_SIZE + 2;
+
+    // One panel of up to 16 outputs over the 81 points:
+    // out = ReLU(in * w * scale + bias [+ res]).
+    // in is [11][11][cpad] of 0..127, so that pairs never saturate in
+    // maddubs. w is the panel, [3x3][cpad/4][16][4]. scale and bias are
+    // padded to 16. res and out are [81][stride], the first n channels
+    // are written. One function per ISA, chosen once at startup like the
+    // panels of CPUGemm.
+    using ConvFunc = void (*)(const std::uint8_t *in, const std::int8_t *w,
+                              int cpad, const float *scale, const float *bias,
+                              const float *res, float *out, int stride, int n);
+
+    inline float relu(float val) {
+        return (val > 0.0f) ? val : 0.0f;
+    }
+
+    inline std::int32_t load32(const std::uint8_t *p) {
+        auto v = std::int32_t{0};
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+
+    void conv_generic(const std::uint8_t *in, const std::int8_t *w,
+                      const int cpad, const float *scale, const float *bias,
+                      const float *res, float *out, const int stride, const int n) {
+        const auto groups = cpad / 4;
+        for (auto y = 0; y < BOARD_SIZE; y++) {
+            for (auto x = 0; x < BOARD_SIZE; x++) {
+                std::int32_t acc[PANEL] = {};
+                for (auto t = 0; t < 9; t++) {
+                    const auto a = in + ((y + t / 3) * PAD_W + x + t % 3) * cpad;
+                    const auto wt = w + t * groups * PANEL * 4;
+                    for (auto g = 0; g < groups; g++) {
+                        for (auto j = 0; j < PANEL; j++) {
+                            for (auto l = 0; l < 4; l++) {
+                                acc[j] += a[g * 4 + l] * wt[(g * PANEL + j) * 4 + l];
+                            }
+                        }
+                    }
+                }
+                const auto i = (y * BOARD_SIZE + x) * stride;
+                for (auto j = 0; j < n; j++) {
+                    auto val = acc[j] * scale[j] + bias[j];
+                    if (res) {
+                        val += res[i + j];
+                    }
+                    out[i + j] = relu(val);
+                }
+            }
+        }
+    }
+
+#ifdef INT8_X86
+    // 8 outputs of a row, n of them written
+    INT8_TARGET("avx2")
+    inline void store_row8(const __m256i *acc, const float *scale, const float *bias,
+                           const float *res, float *out, const int stride, const int n) {
+        const auto vscale = _mm256_loadu_ps(scale);
+        const auto vbias = _mm256_loadu_ps(bias);
+        const auto zero = _mm256_setzero_ps();
+        for (auto x = 0; x < BOARD_SIZE; x++) {
+            auto v = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(acc[x]), vscale), vbias);
+            const auto i = x * stride;
+            if (n == 8) {
+                if (res) {
+                    v = _mm256_add_ps(v, _mm256_loadu_ps(res + i));
+                }
+                _mm256_storeu_ps(out + i, _mm256_max_ps(v, zero));
+                continue;
+            }
+            alignas(32) float tmp[8];
+            _mm256_store_ps(tmp, v);
+            for (auto j = 0; j < n; j++) {
+                out[i + j] = relu(tmp[j] + (res ? res[i + j] : 0.0f));
+            }
+        }
+    }
+
+    // The panel in two halves of 8 outputs, 9 x 8 accumulators
+    INT8_TARGET("avx2")
+    void conv_avx2(const std::uint8_t *in, const std::int8_t *w,
+                   const int cpad, const float *scale, const float *bias,
+                   const float *res, float *out, const int stride, const int n) {
+        const auto groups = cpad / 4;
+        const auto ones = _mm256_set1_epi16(1);
+        for (auto h = 0; h * 8 < n; h++) {
+            for (auto y = 0; y < BOARD_SIZE; y++) {
+                __m256i acc[BOARD_SIZE];
+                for (auto x = 0; x < BOARD_SIZE; x++) {
+                    acc[x] = _mm256_setzero_si256();
+                }
+                for (auto t = 0; t < 9; t++) {
+                    const auto a = in + ((y + t / 3) * PAD_W + t % 3) * cpad;
+                    const auto wt = w + t * groups * PANEL * 4 + h * 32;
+                    for (auto g = 0; g < groups; g++) {
+                        const auto vw = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i *>(wt + g * PANEL * 4));
+                        for (auto x = 0; x < BOARD_SIZE; x++) {
+                            const auto va = _mm256_set1_epi32(load32(a + x * cpad + g * 4));
+                            const auto p16 = _mm256_maddubs_epi16(va, vw);
+                            acc[x] = _mm256_add_epi32(acc[x], _mm256_madd_epi16(p16, ones));
+                        }
+                    }
+                }
+                const auto i = y * BOARD_SIZE * stride + h * 8;
+                store_row8(acc, scale + h * 8, bias + h * 8, res ? res + i : nullptr,
+                           out + i, stride, std::min(n - h * 8, 8));
+            }
+        }
+    }
+
+#ifdef INT8_AVXVNNI
+    INT8_TARGET("avxvnni")
+    void conv_avxvnni(const std::uint8_t *in, const std::int8_t *w,
+                      const int cpad, const float *scale, const float *bias,
+                      const float *res, float *out, const int stride, const int n) {
+        const auto groups = cpad / 4;
+        for (auto h = 0; h * 8 < n; h++) {
+            for (auto y = 0; y < BOARD_SIZE; y++) {
+                __m256i acc[BOARD_SIZE];
+                for (auto x = 0; x < BOARD_SIZE; x++) {
+                    acc[x] = _mm256_setzero_si256();
+                }
+                for (auto t = 0; t < 9; t++) {
+                    const auto a = in + ((y + t / 3) * PAD_W + t % 3) * cpad;
+                    const auto wt = w + t * groups * PANEL * 4 + h * 32;
+                    for (auto g = 0; g < groups; g++) {
+                        const auto vw = _mm256_loadu_si256(
+                            reinterpret_cast<const __m256i *>(wt + g * PANEL * 4));
+                        for (auto x = 0; x < BOARD_SIZE; x++) {
+                            const auto va = _mm256_set1_epi32(load32(a + x * cpad + g * 4));
+                            acc[x] = _mm256_dpbusd_avx_epi32(acc[x], va, vw);
+                        }
+                    }
+                }
+                const auto i = y * BOARD_SIZE * stride + h * 8;
+                store_row8(acc, scale + h * 8, bias + h * 8, res ? res + i : nullptr,
+                           out + i, stride, std::min(n - h * 8, 8));
+            }
+        }
+    }
+#endif
+
+    // The whole panel in one register per point, 9 x 16 accumulators
+    INT8_TARGET("avx512f,avx512vnni")
+    void conv_avx512vnni(const std::uint8_t *in, const std::int8_t *w,
+                         const int cpad, const float *scale, const float *bias,
+                         const float *res, float *out, const int stride, const int n) {
+        const auto groups = cpad / 4;
+        const auto mask = static_cast<__mmask16>((1u << n) - 1);
+        const auto vscale = _mm512_loadu_ps(scale);
+        const auto vbias = _mm512_loadu_ps(bias);
+        const auto zero = _mm512_setzero_ps();
+        for (auto y = 0; y < BOARD_SIZE; y++) {
+            __m512i acc[BOARD_SIZE];
+            for (auto x = 0; x < BOARD_SIZE; x++) {
+                acc[x] = _mm512_setzero_si512();
+            }
+            for (auto t = 0; t < 9; t++) {
+                const auto a = in + ((y + t / 3) * PAD_W + t % 3) * cpad;
+                const auto wt = w + t * groups * PANEL * 4;
+                for (auto g = 0; g < groups; g++) {
+                    const auto vw = _mm512_loadu_si512(wt + g * PANEL * 4);
+                    for (auto x = 0; x < BOARD_SIZE; x++) {
+                        const auto va = _mm512_set1_epi32(load32(a + x * cpad + g * 4));
+                        acc[x] = _mm512_dpbusd_epi32(acc[x], va, vw);
+                    }
+                }
+            }
+            for (auto x = 0; x < BOARD_SIZE; x++) {
+                const auto i = (y * BOARD_SIZE + x) * stride;
+                // the maskz forms, as GCC 12 warns of the undefined source
+                // operand of the plain ones under a target attribute
+                const auto f = _mm512_maskz_cvtepi32_ps(mask, acc[x]);
+                auto v = _mm512_add_ps(_mm512_mul_ps(f, vscale), vbias);
+                if (res) {
+                    v = _mm512_add_ps(v, _mm512_maskz_loadu_ps(mask, res + i));
+                }
+                _mm512_mask_storeu_ps(out + i, mask, _mm512_maskz_max_ps(mask, v, zero));
+            }
+        }
+    }
+#endif
+
+    struct ConvKernel {
+        const char *name;
+        ConvFunc conv;
+    };
+
+    ConvKernel select_conv() {
+#ifdef INT8_X86
+        const auto& f = CPUKernels::features();
+        if (f.avx512f && f.avx512vnni) {
+            return {"AVX-512 VNNI", conv_avx512vnni};
+        }
+#ifdef INT8_AVXVNNI
+        if (f.avxvnni) {
+            return {"AVX-VNNI", conv_avxvnni};
+        }
+#endif
+        if (f.avx2) {
+            return {"AVX2", conv_avx2};
+        }
+#endif
+        return {"generic", conv_generic};
+    }
+
+    const ConvKernel& conv_kernel() {
+        static const auto k = select_conv();
+        return k;
+    }
+}
+
+CPUPipeInt8::CPUPipeInt8(const std::string& filename, bool calibrate)
+    : m_filename(filename), m_calibrate(calibrate) {
+}
+
+void CPUPipeInt8::push_weights(unsigned int filter_size,
+                               unsigned int channels,
+                               unsigned int outputs,
+                               std::shared_ptr<const ForwardPipeWeights> weights) {
+    // The input convolution and the heads, and in calibration the tower
+    CPUPipe::push_weights(filter_size, channels, outputs, weights);
+
+    // Fold batchnorm into the untransformed 3x3 filters, see CPUPipe.
+    m_cpad = (m_input_channels + 3) / 4 * 4;
+    m_kpad = (m_input_channels + PANEL - 1) / PANEL * PANEL;
+    const auto& raw = weights->m_conv_weights_3x3;
+    m_tower.resize(raw.size() - 1);
+    for (auto i = size_t{0}; i < m_tower.size(); i++) {
+        auto& layer = m_tower[i];
+        const auto& means = weights->m_batchnorm_means[i + 1];
+        const auto& stddevs = weights->m_batchnorm_stddevs[i + 1];
+        const auto filter_dim = raw[i + 1].size() / outputs;
+        layer.w = raw[i + 1];
+        layer.bias.resize(outputs);
+        for (auto k = size_t{0}; k < outputs; k++) {
+            for (auto j = size_t{0}; j < filter_dim; j++) {
+                layer.w[k * filter_dim + j] *= stddevs[k];
+            }
+            layer.bias[k] = -stddevs[k] * means[k];
+        }
+    }
+
+    if (m_calibrate) {
+        myprintf("INT8 calibration, writes %s\n", m_filename.c_str());
+        return;
+    }
+    if (!load_quantized()) {
+        myprintf_error("Could not load INT8 weights %s\n", m_filename.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    // Of the FP32 tower only the input convolution is run. Mapped from
+    // the weight cache, the rest is never read in.
+    if (!m_conv_biases.empty()) {
+        for (auto filters : {&m_conv_weights, &m_conv_weights3}) {
+            for (auto i = size_t{1}; i < filters->size(); i++) {
+                std::vector<float>().swap((*filters)[i]);
+            }
+        }
+        for (auto i = size_t{1}; i < m_conv_weights16.size(); i++) {
+            std::vector<std::uint16_t>().swap(m_conv_weights16[i]);
+        }
+        bind_weights();
+    }
+    myprintf("Initializing CPU INT8 evaluation (%s, %s).\n", m_filename.c_str(),
+             conv_kernel().name);
+}
+
+void CPUPipeInt8::quantize_weights(Layer& layer) {
+    const auto filter_dim = m_input_channels * 9;
+    const auto outputs = layer.bias.size();
+    layer.q.resize(outputs * filter_dim);
+    layer.q_scale.resize(outputs);
+    for (auto k = size_t{0}; k < outputs; k++) {
+        const auto w = &layer.w[k * filter_dim];
+        auto wmax = 0.0f;
+        for (auto j = 0; j < filter_dim; j++) {
+            wmax = std::max(wmax, std::abs(w[j]));
+        }
+        const auto scale = (wmax > 0.0f) ? wmax / QMAX : 1.0f;
+        layer.q_scale[k] = scale;
+        for (auto j = 0; j < filter_dim; j++) {
+            layer.q[k * filter_dim + j] =
+                static_cast<std::int8_t>(std::lround(w[j] / scale));
+        }
+    }
+}
+
+// [output][input][3][3] -> [output/16][3x3][input/4][16][4], zero padded
+void CPUPipeInt8::pack_panels(Layer& layer) {
+    const auto C = m_input_channels;
+    const auto groups = m_cpad / 4;
+    layer.panels.assign(m_kpad * 9 * m_cpad, 0);
+    for (auto k = 0; k < C; k++) {
+        const auto p = k / PANEL;
+        const auto j = k % PANEL;
+        for (auto c = 0; c < C; c++) {
+            for (auto t = 0; t < 9; t++) {
+                layer.panels[((p * 9 + t) * groups + c / 4) * PANEL * 4 + j * 4 + c % 4] =
+                    layer.q[(k * C + c) * 9 + t];
+            }
+        }
+    }
+    layer.panel_scale.assign(m_kpad, 0.0f);
+    layer.panel_bias.assign(m_kpad, 0.0f);
+    for (auto k = 0; k < C; k++) {
+        layer.panel_scale[k] = layer.act_scale * layer.q_scale[k];
+        layer.panel_bias[k] = layer.bias[k];
+    }
+}
+
+// aobaz-int8 <version>
+// <tower layers> <channels>
+// then for each tower layer
+// act <activation scale>
+// wscale <channels scales>
+// <channels * channels * 9 int8 weights, [output][input][3][3]>
+bool CPUPipeInt8::save_calibration() {
+    if (!m_calibrate) {
+        return false;
+    }
+    std::ofstream out(m_filename);
+    if (!out) {
+        myprintf_error("Could not write %s\n", m_filename.c_str());
+        return false;
+    }
+    const auto filter_dim = m_input_channels * 9;
+    out << "aobaz-int8 " << INT8_FORMAT_VERSION << "\n";
+    out << m_tower.size() << " " << m_input_channels << "\n";
+    out.precision(9);
+    for (auto i = size_t{0}; i < m_tower.size(); i++) {
+        auto& layer = m_tower[i];
+        quantize_weights(layer);
+        layer.act_scale = (layer.act_max > 0.0f) ? layer.act_max / QMAX : 1.0f;
+        out << "act " << layer.act_scale << "\n";
+        out << "wscale";
+        for (const auto s : layer.q_scale) {
+            out << " " << s;
+        }
+        out << "\n";
+        for (auto k = size_t{0}; k < layer.bias.size(); k++) {
+            for (auto j = 0; j < filter_dim; j++) {
+                out << (j ? " " : "") << static_cast<int>(layer.q[k * filter_dim + j]);
+            }
+            out << "\n";
+        }
+        myprintf("layer %2zu: activation max %8.4f\n", i + 1, layer.act_max);
+    }
+    myprintf("Wrote INT8 weights to %s\n", m_filename.c_str());
+    return static_cast<bool>(out);
+}
+
+bool CPUPipeInt8::load_quantized() {
+    std::ifstream in(m_filename);
+    if (!in) {
+        return false;
+    }
+    auto magic = std::string{};
+    auto version = 0;
+    auto layers = size_t{0};
+    auto channels = 0;
+    in >> magic >> version >> layers >> channels;
+    if (!in || magic != "aobaz-int8" || version != INT8_FORMAT_VERSION) {
+        myprintf_error("%s is not an INT8 weights file.\n", m_filename.c_str());
+        return false;
+    }
+    if (layers != m_tower.size() || channels != m_input_channels) {
+        myprintf_error("INT8 weights are %zu layers x %d channels, network is %zu x %d.\n",
+                       layers, channels, m_tower.size(), m_input_channels);
+        return false;
+    }
+
+    const auto filter_dim = channels * 9;
+    for (auto& layer : m_tower) {
+        auto token = std::string{};
+        in >> token >> layer.act_scale;
+        if (token != "act") {
+            return false;
+        }
+        in >> token;
+        if (token != "wscale") {
+            return false;
+        }
+        layer.q_scale.resize(channels);
+        for (auto& s : layer.q_scale) {
+            in >> s;
+        }
+        layer.q.resize(channels * filter_dim);
+        for (auto& q : layer.q) {
+            auto val = 0;
+            in >> val;
+            q = static_cast<std::int8_t>(val);
+        }
+        if (!in) {
+            return false;
+        }
+        pack_panels(layer);
+        // Only the panels are needed any more.
+        std::vector<float>().swap(layer.w);
+        std::vector<std::int8_t>().swap(layer.q);
+    }
+    return true;
+}
+
+std::vector<std::uint8_t>& CPUPipeInt8::get_qin() {
+    static thread_local std::vector<std::uint8_t> s_qin;
+    return s_qin;
+}
+
+void CPUPipeInt8::convolve3_int8(const Layer& layer,
+                                 const std::vector<float>& input,
+                                 const std::vector<float>* residual,
+                                 std::vector<float>& output,
+                                 const int batch_size) {
+    const auto C = m_input_channels;
+    const auto conv_size = C * NUM_INTERSECTIONS;
+    const auto inv_scale = 1.0f / layer.act_scale;
+    const auto conv = conv_kernel().conv;
+    const auto panel_size = 9 * m_cpad * PANEL;
+
+    // The border stays zero, the board is overwritten. Channels past C
+    // may hold those of a wider network, their weights are zero.
+    auto& qin = get_qin();
+    if (qin.size() != static_cast<size_t>(PAD_W * PAD_W * m_cpad)) {
+        qin.assign(PAD_W * PAD_W * m_cpad, 0);
+    }
+    for (auto b = 0; b < batch_size; b++) {
+        // The input is a ReLU output, >= 0
+        const auto in = &input[b * conv_size];
+        for (auto i = 0; i < NUM_INTERSECTIONS; i++) {
+            const auto y = i / BOARD_SIZE;
+            const auto x = i % BOARD_SIZE;
+            const auto dst = &qin[((y + 1) * PAD_W + x + 1) * m_cpad];
+            for (auto c = 0; c < C; c++) {
+                const auto v = std::min(in[i * C + c] * inv_scale + 0.5f, QMAX);
+                dst[c] = static_cast<std::uint8_t>(static_cast<int>(v));
+            }
+        }
+
+        const auto res = residual ? &(*residual)[b * conv_size] : nullptr;
+        const auto out = &output[b * conv_size];
+        parallel_for(m_kpad / PANEL, 1, [&](const int begin, const int end) {
+            for (auto p = begin; p < end; p++) {
+                const auto k0 = p * PANEL;
+                conv(qin.data(), &layer.panels[p * panel_size], m_cpad,
+                     &layer.panel_scale[k0], &layer.panel_bias[k0],
+                     res ? res + k0 : nullptr, out + k0, C, std::min(PANEL, C - k0));
+            }
+        });
+    }
+}
+
+void CPUPipeInt8::forward_batch(const std::vector<float>& input,
+                                std::vector<float>& output_pol,
+                                std::vector<float>& output_val,
+                                const size_t batch_size) {
+    const auto batch = static_cast<int>(batch_size);
+    const auto conv_size = m_input_channels * NUM_INTERSECTIONS;
+    auto& ws = get_workspace();
+    auto& conv_out = ws.conv_out;
+    auto& conv_in = ws.conv_in;
+    auto& res = ws.res;
+    conv_out.resize(conv_size * batch_size);
+    conv_in.resize(conv_size * batch_size);
+    res.resize(conv_size * batch_size);
+    input_convolve(input, conv_out, batch, ws);
+
+    // Residual tower, m_tower[i] is layer i + 1 of CPUPipe
+    auto record = [](Layer& layer, const std::vector<float>& in) {
+        for (const auto v : in) {
+            layer.act_max = std::max(layer.act_max, v);
+        }
+    };
+    for (auto i = size_t{0}; i < m_tower.size(); i += 2) {
+        std::swap(conv_out, conv_in);
+        std::swap(conv_in, res);
+        if (m_calibrate) {
+            const auto outputs = m_input_channels;
+            record(m_tower[i], res);
+            winograd_convolve3(outputs, res, i + 1, nullptr, ws.V, ws.M, conv_in, batch);
+            record(m_tower[i + 1], conv_in);
+            winograd_convolve3(outputs, conv_in, i + 2, &res, ws.V, ws.M, conv_out, batch);
+        } else {
+            convolve3_int8(m_tower[i], res, nullptr, conv_in, batch);
+            convolve3_int8(m_tower[i + 1], conv_in, &res, conv_out, batch);
+        }
+    }
+
+    convolve_heads(conv_out, output_pol, output_val, batch, ws);
+}
@@ -0,0 +1,82 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef CPUPIPEINT8_H_INCLUDED
+#define CPUPIPEINT8_H_INCLUDED
+#include "config.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CPUPipe.h"
+
+// CPU evaluation with the residual tower in INT8.
+//
+// Weights are quantized per output channel (symmetric, scale = max|w|/127)
+// after batchnorm is folded in. The input of each tower convolution is a
+// ReLU output, so it is quantized to 0..127 with one scale per layer that
+// is calibrated offline (aobaz -q8 file calib records.csa). Accumulation is
+// int32. The input convolution and the heads are those of CPUPipe, in FP32.
+//
+// The filters are packed in panels of 16 outputs, [3x3][C/4][16][4], the
+// layout of VNNI dot products of 4 bytes. A panel is run over a row of 9
+// points at a time, so the 16 x 9 accumulators stay in registers.
+//
+// With calibrate = true the tower runs in FP32 and records the activation
+// range of every layer. save_calibration() then writes the quantized file.
+class CPUPipeInt8 : public CPUPipe {
+public:
+    CPUPipeInt8(const std::string& filename, bool calibrate);
+
+    virtual void forward_batch(const std::vector<float>& input,
+                               std::vector<float>& output_pol,
+                               std::vector<float>& output_val,
+                               const size_t batch_size);
+    virtual void push_weights(unsigned int filter_size,
+                              unsigned int channels,
+                              unsigned int outputs,
+                              std::shared_ptr<const ForwardPipeWeights> weights);
+
+    bool save_calibration();
+
+private:
+    // A tower convolution
+    struct Layer {
+        // batchnorm folded, [output][input][3][3], until quantized
+        std::vector<float> w;
+        std::vector<float> bias;
+        // [output][input][3][3], as in the file
+        std::vector<std::int8_t> q;
+        std::vector<float> q_scale;
+        float act_scale{0.0f};
+        float act_max{0.0f};
+        // q in panels, and act_scale * q_scale and bias padded to them
+        std::vector<std::int8_t> panels;
+        std::vector<float> panel_scale;
+        std::vector<float> panel_bias;
+    };
+
+    // The quantized input of a layer of the calling thread, [11][11][C]
+    // with a zero border. See CPUPipe::Workspace.
+    static std::vector<std::uint8_t>& get_qin();
+
+    void quantize_weights(Layer& layer);
+    void pack_panels(Layer& layer);
+    bool load_quantized();
+    void convolve3_int8(const Layer& layer,
+                        const std::vector<float>& input,
+                        const std::vector<float>* residual,
+                        std::vector<float>& output,
+                        const int batch_size);
+
+    std::string m_filename;
+    bool m_calibrate;
+    // channels rounded up to 4 and to 16, the panel size
+    int m_cpad;
+    int m_kpad;
+
+    // The convolutions after the input convolution
+    std::vector<Layer> m_tower;
+};
+
+#endif
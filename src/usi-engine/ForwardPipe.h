@@ -30,17 +30,25 @@
 #ifndef FORWARDPIPE_H_INCLUDED
 #define FORWARDPIPE_H_INCLUDED
 
+#include <algorithm>
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 #include "config.h"
+#include "BatchScheduler.h"
 
 class ForwardPipe {
 public:
     class ForwardPipeWeights {
     public:
+        // CRC64 of the weights file, the key of WeightCache
+        std::uint64_t m_crc64{0};
+
         // Input + residual block tower
         std::vector<std::vector<float>> m_conv_weights;
+        // untransformed 3x3 filters, for pipes using another Winograd tiling
+        std::vector<std::vector<float>> m_conv_weights_3x3;
         std::vector<std::vector<float>> m_conv_biases;
         std::vector<std::vector<float>> m_batchnorm_means;
         std::vector<std::vector<float>> m_batchnorm_stddevs;
@@ -60,10 +68,42 @@ public:
     virtual void forward(const std::vector<float>& input,
                          std::vector<float>& output_pol,
                          std::vector<float>& output_val) = 0;
+    // Positions are stored one after another in input, output_pol and
+    // output_val. The default evaluates them one at a time.
+    virtual void forward_batch(const std::vector<float>& input,
+                               std::vector<float>& output_pol,
+                               std::vector<float>& output_val,
+                               const size_t batch_size) {
+        const auto in_size = input.size() / batch_size;
+        const auto pol_size = output_pol.size() / batch_size;
+        const auto val_size = output_val.size() / batch_size;
+        auto in = std::vector<float>(in_size);
+        auto pol = std::vector<float>(pol_size);
+        auto val = std::vector<float>(val_size);
+        for (auto b = size_t{0}; b < batch_size; b++) {
+            std::copy(begin(input) + b * in_size,
+                      begin(input) + (b + 1) * in_size, begin(in));
+            forward(in, pol, val);
+            std::copy(begin(pol), end(pol), begin(output_pol) + b * pol_size);
+            std::copy(begin(val), end(val), begin(output_val) + b * val_size);
+        }
+    }
     virtual void push_weights(unsigned int filter_size,
                               unsigned int channels,
                               unsigned int outputs,
                               std::shared_ptr<const ForwardPipeWeights> weights) = 0;
+
+    // true if the pipe queues forward() calls and forms the batches
+    // itself, recording them in batch_scheduler(). Otherwise the caller
+    // records each forward() and forward_batch() call.
+    virtual bool forms_batches() const { return false; }
+    // positions waiting in the pipe for a batch, 0 if it forms none
+    virtual size_t queued() { return 0; }
+    BatchScheduler& batch_scheduler() { return m_batch_scheduler; }
+    const BatchScheduler& batch_scheduler() const { return m_batch_scheduler; }
+
+protected:
+    BatchScheduler m_batch_scheduler;
 };
 
 #endif
@@ -63,6 +63,7 @@ bool cfg_gtp_mode;
 bool cfg_allow_pondering;
 unsigned int cfg_num_threads;
 unsigned int cfg_batch_size;
+int cfg_batch_ms;
 int cfg_max_playouts;
 int cfg_max_visits;
 size_t cfg_max_memory;
@@ -94,12 +95,21 @@ float cfg_fpu_root_reduction;
 float cfg_ci_alpha;
 float cfg_lcb_min_visit_ratio;
 std::string cfg_weightsfile;
+std::string cfg_weightsfile_small;
+std::string cfg_weightsfile_int8;
+std::string cfg_weight_cache;
+std::uint64_t cfg_weights_crc64;
+bool cfg_int8_calibrate;
 std::string cfg_logfile;
 FILE* cfg_logfile_handle;
 bool cfg_quiet;
 std::string cfg_options_str;
 bool cfg_benchmark;
 bool cfg_cpu_only;
+cpu_precision_t cfg_cpu_precision;
+int cfg_cpu_threads;
+int cfg_cpu_affinity;
+std::string cfg_cpu_isa;
 AnalyzeTags cfg_analyze_tags;
 
 #if 0
@@ -299,6 +309,7 @@ bool AnalyzeTags::has_move_restrictions() const {
 #endif
 
 std::unique_ptr<Network> GTP::s_network;
+std::unique_ptr<Network> GTP::s_network_small;
 
 void GTP::initialize(std::unique_ptr<Network>&& net) {
     s_network = std::move(net);
@@ -326,6 +337,7 @@ void GTP::setup_default_parameters() {
     cfg_num_threads = 1;
     // we will re-calculate this on Leela.cpp
     cfg_batch_size = 1;
+    cfg_batch_ms = 0;
 
     cfg_max_memory = UCTSearch::DEFAULT_MAX_MEMORY;
     cfg_max_playouts = UCTSearch::UNLIMITED_PLAYOUTS;
@@ -368,6 +380,11 @@ void GTP::setup_default_parameters() {
 #else
     cfg_cpu_only = false;
 #endif
+    cfg_cpu_precision = cpu_precision_t::SINGLE;
+    cfg_cpu_threads = 1;
+    cfg_cpu_affinity = -1;
+    cfg_cpu_isa.clear();
+    cfg_weights_crc64 = 0;
 
     cfg_analyze_tags = AnalyzeTags{};
 
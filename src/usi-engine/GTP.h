@@ -32,6 +32,7 @@
 
 #include "config.h"
 
+#include <cstdint>
 #include <cstdio>
 #include <string>
 #include <vector>
@@ -83,6 +84,8 @@ extern bool cfg_gtp_mode;
 extern bool cfg_allow_pondering;
 extern unsigned int cfg_num_threads;
 extern unsigned int cfg_batch_size;
+// latency cap (ms) of a batch, 0: the batch size is always cfg_batch_size
+extern int cfg_batch_ms;
 extern int cfg_max_playouts;
 extern int cfg_max_visits;
 extern size_t cfg_max_memory;
@@ -118,11 +121,29 @@ extern float cfg_ci_alpha;
 extern float cfg_lcb_min_visit_ratio;
 extern std::string cfg_logfile;
 extern std::string cfg_weightsfile;
+extern std::string cfg_weightsfile_small;
+extern std::string cfg_weightsfile_int8;
+extern bool cfg_int8_calibrate;
+// directory of WeightCache files, empty: no cache
+extern std::string cfg_weight_cache;
+// CRC64 of the decoded -w weights as autousi knows it, 0: unknown. With it
+// a weight cache hit needs not read the weights file at all.
+extern std::uint64_t cfg_weights_crc64;
 extern FILE* cfg_logfile_handle;
 extern bool cfg_quiet;
 extern std::string cfg_options_str;
 extern bool cfg_benchmark;
 extern bool cfg_cpu_only;
+// storage of the CPU Winograd filters. FP32 accumulation in all cases.
+enum class cpu_precision_t {
+    SINGLE, HALF, BFLOAT16
+};
+extern cpu_precision_t cfg_cpu_precision;
+// threads per CPU forward, and the first logical CPU to pin them to (-1: no pinning)
+extern int cfg_cpu_threads;
+extern int cfg_cpu_affinity;
+// highest ISA level of the CPU kernels, see CPUKernels::limit() (empty: all)
+extern std::string cfg_cpu_isa;
 extern AnalyzeTags cfg_analyze_tags;
 
 static constexpr size_t MiB = 1024LL * 1024LL;
@@ -135,6 +156,7 @@ static constexpr size_t MiB = 1024LL * 1024LL;
 class GTP {
 public:
     static std::unique_ptr<Network> s_network;
+    static std::unique_ptr<Network> s_network_small;
     static void initialize(std::unique_ptr<Network>&& network);
     static void execute(GameState & game, const std::string& xinput);
     static void setup_default_parameters();
@@ -488,9 +488,17 @@ static void parse_commandline(int argc, char *argv[]) {
 static void initialize_network() {
     auto network = std::make_unique<Network>();
     auto playouts = std::min(cfg_max_playouts, cfg_max_visits);
-    network->initialize(playouts, cfg_weightsfile);
+    network->initialize(playouts, cfg_weightsfile, cfg_weightsfile_int8,
+                        cfg_weights_crc64);
 
     GTP::initialize(std::move(network));
+
+    // Optional small network for cheap expansions deep in the tree.
+    if (!cfg_weightsfile_small.empty()) {
+        auto network_small = std::make_unique<Network>();
+        network_small->initialize(playouts, cfg_weightsfile_small);
+        GTP::s_network_small = std::move(network_small);
+    }
 }
 
 // Setup global objects after command line has been parsed
@@ -34,9 +34,16 @@
 #include <algorithm>
 #include <array>
 #include <cassert>
+#include <cinttypes>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
 #include <iterator>
 #include <memory>
+#include <numeric>
 #include <sstream>
 #include <string>
 #include <boost/utility.hpp>
@@ -56,9 +63,11 @@
 #include <cblas.h>
 #endif
 #include "zlib.h"
+#include "xzi.hpp"
 
 #include "Network.h"
 #include "CPUPipe.h"
+#include "CPUPipeInt8.h"
 #ifdef USE_OPENCL
 #include "OpenCLScheduler.h"
 #include "UCTNode.h"
@@ -72,7 +81,9 @@
 #include "Random.h"
 #include "ThreadPool.h"
 #include "Timing.h"
+#include "Trace.h"
 #include "Utils.h"
+#include "WeightCache.h"
 
 namespace x3 = boost::spirit::x3;
 using namespace Utils;
@@ -238,7 +249,248 @@ std::vector<float> Network::winograd_transform_f(const std::vector<float>& f,
     return U;
 }
 
-std::pair<int, int> Network::load_v1_network(std::istream& wtfile) {
+// One line of the text format after the version line, or one section of
+// the binary format. Both loaders store weights through here.
+void Network::set_weights_line(const size_t linecount,
+                               const size_t plain_conv_wts,
+                               std::vector<float>& weights) {
+    if (linecount < plain_conv_wts) {
+        if (linecount % 4 == 0) {
+            m_fwd_weights->m_conv_weights.emplace_back(weights);
+        } else if (linecount % 4 == 1) {
+            // Redundant in our model, but they encode the
+            // number of outputs so we have to read them in.
+            m_fwd_weights->m_conv_biases.emplace_back(weights);
+        } else if (linecount % 4 == 2) {
+				modify_bn_scale_factor(weights);
+            m_fwd_weights->m_batchnorm_means.emplace_back(weights);
+        } else if (linecount % 4 == 3) {
+				modify_bn_scale_factor(weights);
+            process_bn_var(weights);
+            m_fwd_weights->m_batchnorm_stddevs.emplace_back(weights);
+        }
+    } else {
+        switch (linecount - plain_conv_wts) {
+            case  0: m_fwd_weights->m_conv_pol_w = std::move(weights); break;
+            case  1: m_fwd_weights->m_conv_pol_b = std::move(weights); break;
+            case  2: modify_bn_scale_factor(weights);
+                     std::copy(cbegin(weights), cend(weights),
+                               begin(m_bn_pol_w1)); break;
+            case  3: modify_bn_scale_factor(weights);
+                     process_bn_var(weights);
+                     std::copy(cbegin(weights), cend(weights),
+                               begin(m_bn_pol_w2)); break;
+            case  4:
+/*
+                     if (weights.size() != OUTPUTS_POLICY
+                                           * NUM_INTERSECTIONS
+                                           * POTENTIAL_MOVES) {
+                         myprintf("The weights file is not for %dx%d boards.\n",
+                                  BOARD_SIZE, BOARD_SIZE);
+                         return {0, 0};
+                     }
+*/
+//                       std::copy(cbegin(weights), cend(weights),
+//                                 begin(m_ip_pol_w)); break;
+                     m_conv2_pol_w = std::move(weights); break;
+            case  5:
+//                       std::copy(cbegin(weights), cend(weights),
+//                                 begin(m_ip_pol_b)); break;
+                     m_conv2_pol_b = std::move(weights); break;
+            case  6: m_fwd_weights->m_conv_val_w = std::move(weights); break;
+            case  7: m_fwd_weights->m_conv_val_b = std::move(weights); break;
+            case  8: modify_bn_scale_factor(weights);
+                     std::copy(cbegin(weights), cend(weights),
+                               begin(m_bn_val_w1)); break;
+            case  9: modify_bn_scale_factor(weights);
+                     process_bn_var(weights);
+                     std::copy(cbegin(weights), cend(weights),
+                               begin(m_bn_val_w2)); break;
+            case 10: std::copy(cbegin(weights), cend(weights),
+                               begin(m_ip1_val_w)); break;
+            case 11: std::copy(cbegin(weights), cend(weights),
+                               begin(m_ip1_val_b)); break;
+            case 12: std::copy(cbegin(weights), cend(weights),
+                               begin(m_ip2_val_w)); break;
+            case 13: std::copy(cbegin(weights), cend(weights),
+                               begin(m_ip2_val_b)); break;
+        }
+    }
+}
+
+namespace {
+    // Binary weight file, see src/common/wbin.hpp for the layout
+    constexpr char wbin_magic[8] = { 'A', 'O', 'B', 'A', 'W', 'B', 'I', 'N' };
+    constexpr auto wbin_version = std::uint32_t{1};
+    constexpr auto wbin_align = size_t{64};
+
+    struct WBinHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t version_text;
+        std::uint32_t blocks;
+        std::uint32_t channels;
+        std::uint32_t sections;
+        std::uint32_t reserved;
+        std::uint64_t crc64;
+        char padding[24];
+    };
+    static_assert(sizeof(WBinHeader) == 64, "WBinHeader must be 64 bytes");
+
+    size_t wbin_align_up(const size_t n) {
+        return (n + wbin_align - 1) / wbin_align * wbin_align;
+    }
+
+    // .xz stream header
+    constexpr char xz_magic[6] = { '\xFD', '7', 'z', 'X', 'Z', '\0' };
+
+    // Splits the text weights into lines as they come in from zlib or
+    // XZDecode, and parses each line, one layer, on a thread of its own
+    // pool while the rest of the file is still being read.
+    class WeightLineParser : public XZSink {
+    public:
+        WeightLineParser() {
+            m_pool.initialize(std::max(1u, std::thread::hardware_concurrency()));
+        }
+
+        void write(const char *p, size_t len) noexcept override {
+            m_crc64 = Utils::crc64(p, len, m_crc64);
+            while (len > 0) {
+                const auto eol = static_cast<const char *>(std::memchr(p, '\n', len));
+                const auto n = eol ? static_cast<size_t>(eol - p) : len;
+                m_line.append(p, n);
+                if (eol == nullptr) {
+                    break;
+                }
+                parse_line();
+                p += n + 1;
+                len -= n + 1;
+            }
+        }
+
+        // Waits for all lines. Returns the number of the first line that
+        // failed to parse, counting from 1, or 0.
+        size_t finish() {
+            if (!m_line.empty()) {
+                parse_line();
+            }
+            auto bad_line = size_t{0};
+            for (auto i = size_t{0}; i < m_results.size(); i++) {
+                if (!m_results[i].get() && bad_line == 0) {
+                    bad_line = i + 1;
+                }
+            }
+            return bad_line;
+        }
+
+        std::deque<std::vector<float>>& lines() { return m_lines; }
+        std::uint64_t crc64() const { return m_crc64; }
+
+    private:
+        void parse_line() {
+            m_lines.emplace_back();
+            auto& weights = m_lines.back();
+            m_results.emplace_back(m_pool.add_task(
+                [&weights](const std::string& line) {
+                    auto it_line = line.cbegin();
+                    const auto ok = phrase_parse(it_line, line.cend(),
+                                                 *x3::float_, x3::space, weights);
+                    return ok && it_line == line.cend();
+                }, std::move(m_line)));
+            m_line.clear();
+        }
+
+        std::string m_line;
+        // a deque, as the tasks write into it while it grows
+        std::deque<std::vector<float>> m_lines;
+        std::vector<std::future<bool>> m_results;
+        std::uint64_t m_crc64{0};
+        // last, so that it joins the tasks before m_lines goes
+        Utils::ThreadPool m_pool;
+    };
+
+    // Tells the binary format from the text by the first decoded bytes
+    // of an .xz file. The binary is kept whole, the text goes on to the
+    // parser.
+    class XZWeightSink : public XZSink {
+    public:
+        explicit XZWeightSink(WeightLineParser& parser) : m_parser(parser) {}
+
+        void write(const char *p, size_t len) noexcept override {
+            if (m_text) {
+                m_parser.write(p, len);
+                return;
+            }
+            m_binary.insert(m_binary.end(), p, p + len);
+            if (m_binary.size() >= sizeof(wbin_magic) && !is_binary()) {
+                to_text();
+            }
+        }
+
+        // Returns true for the binary format.
+        bool finish() {
+            if (!m_text && !is_binary()) {
+                to_text();
+            }
+            return !m_text;
+        }
+
+        const std::vector<char>& binary() const { return m_binary; }
+
+    private:
+        bool is_binary() const {
+            return m_binary.size() >= sizeof(wbin_magic)
+                && std::memcmp(m_binary.data(), wbin_magic, sizeof(wbin_magic)) == 0;
+        }
+        void to_text() {
+            m_text = true;
+            m_parser.write(m_binary.data(), m_binary.size());
+            std::vector<char>().swap(m_binary);
+        }
+
+        WeightLineParser& m_parser;
+        bool m_text{false};
+        std::vector<char> m_binary;
+    };
+
+    // CRC64 of the weights as load_network_file() finds it, without
+    // parsing: from the header of the binary format, or by reading the
+    // text through. 0 for .xz, which would take decoding.
+    std::uint64_t read_weights_crc64(const std::string& filename) {
+        {
+            auto ifs = std::ifstream{filename, std::ios::binary};
+            WBinHeader header;
+            ifs.read(reinterpret_cast<char *>(&header), sizeof(header));
+            const auto len = static_cast<size_t>(ifs.gcount());
+            if (len >= sizeof(wbin_magic)
+                && std::memcmp(header.magic, wbin_magic, sizeof(wbin_magic)) == 0) {
+                return (len == sizeof(header)) ? header.crc64 : 0;
+            }
+            if (len >= sizeof(xz_magic)
+                && std::memcmp(header.magic, xz_magic, sizeof(xz_magic)) == 0) {
+                return 0;
+            }
+        }
+        auto gzhandle = gzopen(filename.c_str(), "rb");
+        if (gzhandle == nullptr) {
+            return 0;
+        }
+        auto crc64 = std::uint64_t{0};
+        auto buffer = std::vector<char>(256 * 1024);
+        while (true) {
+            const auto len = gzread(gzhandle, buffer.data(), buffer.size());
+            if (len <= 0) {
+                crc64 = (len < 0) ? 0 : crc64;
+                break;
+            }
+            crc64 = Utils::crc64(buffer.data(), len, crc64);
+        }
+        gzclose(gzhandle);
+        return crc64;
+    }
+}
+
+std::pair<int, int> Network::load_v1_network(std::deque<std::vector<float>>& lines) {
     // Count size of the network
     myprintf("Detecting residual layers...");
 
@@ -249,177 +501,181 @@ std::pair<int, int> Network::load_v1_network(std::istream& wtfile) {
         myprintf("v%d...", 1);
     }
 
-    // First line was the version number
-    auto linecount = size_t{1};
+    // The first line was the version number.
+    // Third line of parameters are the convolution layer biases,
+    // so this tells us the amount of channels in the residual layers.
+    // We are assuming all layers have the same amount of filters.
+    const auto linecount = lines.size();
     auto channels = 0;
-    auto line = std::string{};
-    while (std::getline(wtfile, line)) {
-        auto iss = std::stringstream{line};
-        // Third line of parameters are the convolution layer biases,
-        // so this tells us the amount of channels in the residual layers.
-        // We are assuming all layers have the same amount of filters.
-        if (linecount == 2) {
-            auto count = std::distance(std::istream_iterator<std::string>(iss),
-                                       std::istream_iterator<std::string>());
-            myprintf("%d channels...", count);
-            channels = count;
-        }
-        linecount++;
+    if (linecount > 2) {
+        channels = static_cast<int>(lines[2].size());
+        myprintf("%d channels...", channels);
     }
     // 1 format id, 1 input layer (4 x weights), 14 ending weights,
     // the rest are residuals, every residual has 8 x weight lines
-    auto residual_blocks = linecount - (1 + 4 + 14);
-    if (residual_blocks % 8 != 0) {
+    if (linecount < 1 + 4 + 14 || (linecount - (1 + 4 + 14)) % 8 != 0) {
         myprintf("\nInconsistent number of weights in the file.\n");
         return {0, 0};
     }
+    auto residual_blocks = linecount - (1 + 4 + 14);
 	myprintf("linecount=%d...",linecount);
     residual_blocks /= 8;
     myprintf("%d blocks.\n", residual_blocks);
 
-    // Re-read file and process
-    wtfile.clear();
-    wtfile.seekg(0, std::ios::beg);
-
-    // Get the file format id out of the way
-    std::getline(wtfile, line);
-
     const auto plain_conv_layers = 1 + (residual_blocks * 2);
     const auto plain_conv_wts = plain_conv_layers * 4;
-    linecount = 0;
     int num = 0;
-    while (std::getline(wtfile, line)) {
-        std::vector<float> weights;
-        auto it_line = line.cbegin();
-        const auto ok = phrase_parse(it_line, line.cend(),
-                                     *x3::float_, x3::space, weights);
-        num += weights.size();
-        if (!ok || it_line != line.cend()) {
-            myprintf("\nFailed to parse weight file. Error on line %d.\n",
-                    linecount + 2); //+1 from version line, +1 from 0-indexing
-            return {0, 0};
-        }
-        if (linecount < plain_conv_wts) {
-            if (linecount % 4 == 0) {
-                m_fwd_weights->m_conv_weights.emplace_back(weights);
-            } else if (linecount % 4 == 1) {
-                // Redundant in our model, but they encode the
-                // number of outputs so we have to read them in.
-                m_fwd_weights->m_conv_biases.emplace_back(weights);
-            } else if (linecount % 4 == 2) {
-				modify_bn_scale_factor(weights);
-                m_fwd_weights->m_batchnorm_means.emplace_back(weights);
-            } else if (linecount % 4 == 3) {
-				modify_bn_scale_factor(weights);
-                process_bn_var(weights);
-                m_fwd_weights->m_batchnorm_stddevs.emplace_back(weights);
-            }
-        } else {
-            switch (linecount - plain_conv_wts) {
-                case  0: m_fwd_weights->m_conv_pol_w = std::move(weights); break;
-                case  1: m_fwd_weights->m_conv_pol_b = std::move(weights); break;
-                case  2: modify_bn_scale_factor(weights);
-                         std::copy(cbegin(weights), cend(weights),
-                                   begin(m_bn_pol_w1)); break;
-                case  3: modify_bn_scale_factor(weights);
-                         process_bn_var(weights);
-                         std::copy(cbegin(weights), cend(weights),
-                                   begin(m_bn_pol_w2)); break;
-                case  4:
-/*
-                         if (weights.size() != OUTPUTS_POLICY
-                                               * NUM_INTERSECTIONS
-                                               * POTENTIAL_MOVES) {
-                             myprintf("The weights file is not for %dx%d boards.\n",
-                                      BOARD_SIZE, BOARD_SIZE);
-                             return {0, 0};
-                         }
-*/
-//                       std::copy(cbegin(weights), cend(weights),
-//                                 begin(m_ip_pol_w)); break;
-                         m_conv2_pol_w = std::move(weights); break;
-                case  5:
-//                       std::copy(cbegin(weights), cend(weights),
-//                                 begin(m_ip_pol_b)); break;
-                         m_conv2_pol_b = std::move(weights); break;
-                case  6: m_fwd_weights->m_conv_val_w = std::move(weights); break;
-                case  7: m_fwd_weights->m_conv_val_b = std::move(weights); break;
-                case  8: modify_bn_scale_factor(weights);
-                         std::copy(cbegin(weights), cend(weights),
-                                   begin(m_bn_val_w1)); break;
-                case  9: modify_bn_scale_factor(weights);
-                         process_bn_var(weights);
-                         std::copy(cbegin(weights), cend(weights),
-                                   begin(m_bn_val_w2)); break;
-                case 10: std::copy(cbegin(weights), cend(weights),
-                                   begin(m_ip1_val_w)); break;
-                case 11: std::copy(cbegin(weights), cend(weights),
-                                   begin(m_ip1_val_b)); break;
-                case 12: std::copy(cbegin(weights), cend(weights),
-                                   begin(m_ip2_val_w)); break;
-                case 13: std::copy(cbegin(weights), cend(weights),
-                                   begin(m_ip2_val_b)); break;
-            }
-        }
-        linecount++;
+    for (auto i = size_t{1}; i < linecount; i++) {
+        num += lines[i].size();
+        set_weights_line(i - 1, plain_conv_wts, lines[i]);
+        std::vector<float>().swap(lines[i]);
     }
 //  process_bn_var(m_bn_pol_w2);
 //  process_bn_var(m_bn_val_w2);
-	myprintf("num=%d...linecount=%d\n",num,linecount);
+	myprintf("num=%d...linecount=%d\n",num,linecount - 1);
 
     return {channels, static_cast<int>(residual_blocks)};
 }
 
-std::pair<int, int> Network::load_network_file(const std::string& filename) {
-    // gzopen supports both gz and non-gz files, will decompress
-    // or just read directly as needed.
-    auto gzhandle = gzopen(filename.c_str(), "rb");
-    if (gzhandle == nullptr) {
+std::pair<int, int> Network::load_binary_network(const std::string& filename) {
+    Utils::MappedFile file;
+    if (!file.open(filename)) {
         myprintf("Could not open weights file: %s\n", filename.c_str());
         return {0, 0};
     }
-    // Stream the gz file in to a memory buffer stream.
-    auto buffer = std::stringstream{};
-    constexpr auto chunkBufferSize = 64 * 1024;
-    std::vector<char> chunkBuffer(chunkBufferSize);
-    while (true) {
-        auto bytesRead = gzread(gzhandle, chunkBuffer.data(), chunkBufferSize);
-        if (bytesRead == 0) break;
-        if (bytesRead < 0) {
-            myprintf("Failed to decompress or read: %s\n", filename.c_str());
-            gzclose(gzhandle);
+    return load_binary_network(file.data(), file.size());
+}
+
+std::pair<int, int> Network::load_binary_network(const char *data, const size_t size) {
+    WBinHeader header;
+    if (size < sizeof(header)) {
+        myprintf("Binary weights file is truncated.\n");
+        return {0, 0};
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.version != wbin_version || header.version_text != 2) {
+        myprintf("Binary weights file is the wrong version.\n");
+        return {0, 0};
+    }
+    const auto sections = size_t{header.sections};
+    if (sections != 4 + 14 + 8 * size_t{header.blocks}
+        || size < sizeof(header) + sections * sizeof(std::uint64_t)) {
+        myprintf("Inconsistent number of weights in the file.\n");
+        return {0, 0};
+    }
+    if (Utils::crc64(data + sizeof(header), size - sizeof(header)) != header.crc64) {
+        myprintf("Binary weights file is corrupt (CRC64 mismatch).\n");
+        return {0, 0};
+    }
+    // Same as the version line 2 of the text format
+    m_value_head_not_stm = true;
+    m_fwd_weights->m_crc64 = header.crc64;
+    myprintf("Binary weights v%u...%u channels...%u blocks.\n",
+             header.version, header.channels, header.blocks);
+
+    // The sections are read in place from the mapping, no parsing.
+    const auto count = reinterpret_cast<const std::uint64_t *>(data + sizeof(header));
+    const auto plain_conv_wts = (1 + size_t{header.blocks} * 2) * 4;
+    // The padding up to each alignment is in the file, so an offset past
+    // its end is a truncated file, and size - offset must not wrap.
+    auto offset = wbin_align_up(sizeof(header) + sections * sizeof(std::uint64_t));
+    if (offset > size) {
+        myprintf("Binary weights file is truncated.\n");
+        return {0, 0};
+    }
+    for (auto i = size_t{0}; i < sections; i++) {
+        if (count[i] > (size - offset) / sizeof(float)) {
+            myprintf("Binary weights file is truncated.\n");
+            return {0, 0};
+        }
+        const auto p = reinterpret_cast<const float *>(data + offset);
+        auto weights = std::vector<float>(p, p + count[i]);
+        set_weights_line(i, plain_conv_wts, weights);
+        offset = wbin_align_up(offset + count[i] * sizeof(float));
+        if (offset > size) {
+            myprintf("Binary weights file is truncated.\n");
             return {0, 0};
         }
-        assert(bytesRead <= chunkBufferSize);
-        buffer.write(chunkBuffer.data(), bytesRead);
     }
-    gzclose(gzhandle);
+    return {static_cast<int>(header.channels), static_cast<int>(header.blocks)};
+}
 
-    // Read format version
-    auto line = std::string{};
-    auto format_version = -1;
-    if (std::getline(buffer, line)) {
-        auto iss = std::stringstream{line};
-        // First line is the file format version id
-        iss >> format_version;
-        if (iss.fail() || (format_version != 2)) {
-            myprintf("Weights file is the wrong version.\n");
+std::pair<int, int> Network::load_network_file(const std::string& filename) {
+    // The binary format and xz are told by their magic, whatever the
+    // file name.
+    auto is_xz = false;
+    {
+        auto ifs = std::ifstream{filename, std::ios::binary};
+        char magic[sizeof(wbin_magic)] = {};
+        ifs.read(magic, sizeof(magic));
+        if (ifs.gcount() == sizeof(magic)
+            && std::memcmp(magic, wbin_magic, sizeof(magic)) == 0) {
+            return load_binary_network(filename);
+        }
+        is_xz = (ifs.gcount() >= static_cast<std::streamsize>(sizeof(xz_magic))
+                 && std::memcmp(magic, xz_magic, sizeof(xz_magic)) == 0);
+    }
+
+    // The lines are parsed while the file is decompressed, no
+    // decompressed copy of the text is kept in memory or on disk.
+    WeightLineParser parser;
+    if (is_xz) {
+        auto ifs = std::ifstream{filename, std::ios::binary};
+        XZDecode<std::ifstream, XZSink> xzd;
+        XZWeightSink sink(parser);
+        if (!xzd.decode(&ifs, &sink, SIZE_MAX)) {
+            myprintf("Failed to decompress or read: %s\n", filename.c_str());
             return {0, 0};
-        } else {
-            // Version 2 networks are identical to v1, except
-            // that they return the value for black instead of
-            // the player to move. This is used by ELF Open Go.
-
-            if (format_version == 2) {
-                m_value_head_not_stm = true;
-            } else {
-                m_value_head_not_stm = false;
+        }
+        if (sink.finish()) {
+            return load_binary_network(sink.binary().data(), sink.binary().size());
+        }
+    } else {
+        // gzopen supports both gz and non-gz files, will decompress
+        // or just read directly as needed.
+        auto gzhandle = gzopen(filename.c_str(), "rb");
+        if (gzhandle == nullptr) {
+            myprintf("Could not open weights file: %s\n", filename.c_str());
+            return {0, 0};
+        }
+        constexpr auto chunkBufferSize = 64 * 1024;
+        std::vector<char> chunkBuffer(chunkBufferSize);
+        while (true) {
+            auto bytesRead = gzread(gzhandle, chunkBuffer.data(), chunkBufferSize);
+            if (bytesRead == 0) break;
+            if (bytesRead < 0) {
+                myprintf("Failed to decompress or read: %s\n", filename.c_str());
+                gzclose(gzhandle);
+                return {0, 0};
             }
-
-            return load_v1_network(buffer);
+            assert(bytesRead <= chunkBufferSize);
+            parser.write(chunkBuffer.data(), bytesRead);
         }
+        gzclose(gzhandle);
+    }
+    const auto bad_line = parser.finish();
+    m_fwd_weights->m_crc64 = parser.crc64();
+
+    // Read format version
+    auto& lines = parser.lines();
+    if (lines.empty()) {
+        return {0, 0};
     }
-    return {0, 0};
+    // First line is the file format version id
+    if ((bad_line == 1) || lines[0].size() != 1 || lines[0][0] != 2.0f) {
+        myprintf("Weights file is the wrong version.\n");
+        return {0, 0};
+    }
+    if (bad_line != 0) {
+        myprintf("\nFailed to parse weight file. Error on line %d.\n", bad_line);
+        return {0, 0};
+    }
+    // Version 2 networks are identical to v1, except
+    // that they return the value for black instead of
+    // the player to move. This is used by ELF Open Go.
+    m_value_head_not_stm = true;
+
+    return load_v1_network(lines);
 }
 /*
 std::unique_ptr<ForwardPipe>&& Network::init_net(int channels,
@@ -436,9 +692,22 @@ std::unique_ptr<ForwardPipe> Network::init_net(int channels,
 
     pipe->initialize(channels);
     pipe->push_weights(WINOGRAD_ALPHA, INPUT_CHANNELS, channels, m_fwd_weights);
+    pipe->batch_scheduler().initialize(cfg_batch_size, cfg_batch_ms);
     return pipe;
 }
 
+std::unique_ptr<ForwardPipe> Network::init_int8(int channels,
+    const std::string & int8file) {
+
+    auto pipe = std::make_unique<CPUPipeInt8>(int8file, cfg_int8_calibrate);
+    m_int8 = pipe.get();
+    return init_net(channels, std::move(pipe));
+}
+
+bool Network::save_int8_calibration() {
+    return m_int8 != nullptr && m_int8->save_calibration();
+}
+
 #ifdef USE_HALF
 void Network::select_precision(int channels) {
     if (cfg_precision == precision_t::AUTO) {
@@ -517,7 +786,9 @@ void Network::select_precision(int channels) {
 }
 #endif
 
-void Network::initialize(int /*playouts*/, const std::string & weightsfile) {
+void Network::initialize(int /*playouts*/, const std::string & weightsfile,
+                         const std::string & int8file,
+                         const std::uint64_t weights_crc64) {
 #ifdef USE_BLAS
 #ifndef __APPLE__
 #ifdef USE_OPENBLAS
@@ -537,6 +808,25 @@ void Network::initialize(int /*playouts*/, const std::string & weightsfile) {
              EIGEN_WORLD_VERSION, EIGEN_MAJOR_VERSION, EIGEN_MINOR_VERSION);
 #endif
 
+    if (!cfg_cpu_isa.empty() && !CPUKernels::limit(cfg_cpu_isa)) {
+        myprintf("Unknown CPU ISA level %s, using all the CPU has.\n", cfg_cpu_isa.c_str());
+    }
+
+    // A CPU engine whose weights are all in the weight cache maps them
+    // and is done: the weights are not parsed or transformed, and no
+    // FP32 copy of them is made.
+#ifdef USE_OPENCL
+    const auto use_cache = int8file.empty() && cfg_cpu_only && !cfg_weight_cache.empty();
+#else
+    const auto use_cache = int8file.empty() && !cfg_weight_cache.empty();
+#endif
+    if (use_cache) {
+        const auto crc64 = weights_crc64 ? weights_crc64 : read_weights_crc64(weightsfile);
+        if (crc64 != 0 && init_from_cache(crc64)) {
+            return;
+        }
+    }
+
     m_fwd_weights = std::make_shared<ForwardPipeWeights>();
 /*
     // Make a guess at a good size as long as the user doesn't
@@ -562,6 +852,8 @@ void Network::initialize(int /*playouts*/, const std::string & weightsfile) {
         exit(EXIT_FAILURE);
     }
 
+    m_fwd_weights->m_conv_weights_3x3 = m_fwd_weights->m_conv_weights;
+
     auto weight_index = size_t{0};
     // Input convolution
     // Winograd transform convolution weights
@@ -602,7 +894,9 @@ void Network::initialize(int /*playouts*/, const std::string & weightsfile) {
     }
 
 #ifdef USE_OPENCL
-    if (cfg_cpu_only) {
+    if (!int8file.empty()) {
+        m_forward = init_int8(channels, int8file);
+    } else if (cfg_cpu_only) {
         myprintf("Initializing CPU-only evaluation.\n");
         m_forward = init_net(channels, std::make_unique<CPUPipe>());
     } else {
@@ -623,23 +917,81 @@ void Network::initialize(int /*playouts*/, const std::string & weightsfile) {
     }
 
 #else //!USE_OPENCL
-    myprintf("Initializing CPU-only evaluation.\n");
-    m_forward = init_net(channels, std::make_unique<CPUPipe>());
+    if (!int8file.empty()) {
+        m_forward = init_int8(channels, int8file);
+    } else {
+        myprintf("Initializing CPU-only evaluation.\n");
+        m_forward = init_net(channels, std::make_unique<CPUPipe>());
+    }
 #endif
 
     // Need to estimate size before clearing up the pipe.
     get_estimated_size();
+    if (use_cache) {
+        store_cache(m_fwd_weights->m_crc64, channels, residual_blocks);
+    }
     m_fwd_weights.reset();
 }
 
+void Network::store_cache(const std::uint64_t crc64, const int channels,
+                          const int residual_blocks) {
+    WeightCache cache(cfg_weight_cache, crc64, "net");
+    if (cache.load()) {
+        return;
+    }
+    const auto config = std::vector<std::int64_t>{
+        channels, residual_blocks, static_cast<std::int64_t>(estimated_size)};
+    cache.add(config);
+    cache.add(m_bn_pol_w1);
+    cache.add(m_bn_pol_w2);
+    cache.add(m_conv2_pol_w);
+    cache.add(m_conv2_pol_b);
+    cache.add(m_bn_val_w1);
+    cache.add(m_bn_val_w2);
+    cache.add(m_ip1_val_w);
+    cache.add(m_ip1_val_b);
+    cache.add(m_ip2_val_w);
+    cache.add(m_ip2_val_b);
+    cache.store();
+}
+
+bool Network::init_from_cache(const std::uint64_t crc64) {
+    WeightCache cache(cfg_weight_cache, crc64, "net");
+    auto config = std::vector<std::int64_t>{};
+    if (!cache.load() || !cache.read(config) || config.size() != 3
+        || !cache.read(m_bn_pol_w1) || !cache.read(m_bn_pol_w2)
+        || !cache.read(m_conv2_pol_w) || !cache.read(m_conv2_pol_b)
+        || !cache.read(m_bn_val_w1) || !cache.read(m_bn_val_w2)
+        || !cache.read(m_ip1_val_w) || !cache.read(m_ip1_val_b)
+        || !cache.read(m_ip2_val_w) || !cache.read(m_ip2_val_b)) {
+        return false;
+    }
+    const auto channels = static_cast<int>(config[0]);
+    myprintf("Initializing CPU-only evaluation.\n");
+    auto pipe = std::make_unique<CPUPipe>();
+    pipe->initialize(channels);
+    if (!pipe->push_cached_weights(crc64)) {
+        return false;
+    }
+    pipe->batch_scheduler().initialize(cfg_batch_size, cfg_batch_ms);
+    m_forward = std::move(pipe);
+    // both text and binary weights are version 2
+    m_value_head_not_stm = true;
+    estimated_size = static_cast<size_t>(config[2]);
+    myprintf("Weights %016" PRIx64 " from the weight cache...%d channels...%d blocks.\n",
+             crc64, channels, static_cast<int>(config[1]));
+    return true;
+}
+
 template<unsigned int inputs,
          unsigned int outputs,
          bool ReLU,
          size_t W>
-std::vector<float> innerproduct(const std::vector<float>& input,
-                                const std::array<float, W>& weights,
-                                const std::array<float, outputs>& biases) {
-    std::vector<float> output(outputs);
+void innerproduct(const std::vector<float>& input,
+                  const std::array<float, W>& weights,
+                  const std::array<float, outputs>& biases,
+                  std::vector<float>& output) {
+    output.resize(outputs);
 
 #ifdef USE_BLAS
     cblas_sgemv(CblasRowMajor, CblasNoTrans,
@@ -665,8 +1017,6 @@ std::vector<float> innerproduct(const std::vector<float>& input,
         }
         output[o] = val;
     }
-
-    return output;
 }
 
 template <size_t spatial_size>
@@ -747,16 +1097,16 @@ T relative_difference(T a, T b) {
 
 //void compare_net_outputs(std::vector<float>& data,
 //                         std::vector<float>& ref) {
-void Network::compare_net_outputs(std::vector<scored_node>& data,
-                                  std::vector<scored_node>& ref) {
+void Network::compare_net_outputs(std::vector<float>& data,
+                                  std::vector<float>& ref) {
     // We accept an error up to 5%, but output values
     // smaller than 1/1000th are "rounded up" for the comparison.
     constexpr float relative_error = 5e-2f;
     for (auto idx = size_t{0}; idx < data.size(); ++idx) {
-        auto err = relative_difference(data[idx].first, ref[idx].first);
+        auto err = relative_difference(data[idx], ref[idx]);
         if (err > relative_error) {
             printf("Error in OpenCL calculation: expected %f got %f "
-                   "(error=%f%%)\n", ref[idx].first, data[idx].first, err * 100.0);
+                   "(error=%f%%)\n", ref[idx], data[idx], err * 100.0);
             printf("Update your GPU drivers or reduce the amount of games "
                    "played simultaneously.\n");
             throw std::runtime_error("OpenCL self-check mismatch.");
@@ -815,10 +1165,9 @@ bool Network::probe_cache(const GameState* const state,
     return false;
 }
 */
-Network::Netresult_old Network::get_output(
-    NNPlanes & planes, const bool force_selfcheck) {
+void Network::get_output(
+    Workspace & ws, const bool force_selfcheck) {
 //    Netresult result;
-    Netresult_old result;
 /*
     if (state->board.get_boardsize() != BOARD_SIZE) {
         return result;
@@ -854,7 +1203,7 @@ Network::Netresult_old Network::get_output(
         assert(symmetry == -1);
 */
 //        const auto rand_sym = Random::get_Rng().randfix<NUM_SYMMETRIES>();
-        result = get_output_internal(planes);
+        get_output_internal(ws);
 #ifdef USE_OPENCL_SELFCHECK
         // Both implementations are available, self-check the OpenCL driver by
         // running both with a probability of 1/2000.
@@ -863,8 +1212,17 @@ Network::Netresult_old Network::get_output(
         if (m_forward_cpu != nullptr
             && (force_selfcheck || Random::get_Rng().randfix<SELFCHECK_PROBABILITY>() == 0)
         ) {
-            auto result_ref = get_output_internal(planes, true);
-            compare_net_outputs(result.first, result_ref.first);
+            // Compare the priors of all 11259 moves, as before the
+            // legal-move-only head.
+            Workspace ref;
+            ref.input = ws.input;
+            get_output_internal(ref, true);
+            std::vector<int> ids(POLICY_OUT_NUM);
+            std::iota(begin(ids), end(ids), 0);
+            std::vector<float> policy, policy_ref;
+            get_legal_policy(ws.result.first, ids, policy);
+            get_legal_policy(ref.result.first, ids, policy_ref);
+            compare_net_outputs(policy, policy_ref);
         }
 #else
         (void)force_selfcheck;
@@ -885,32 +1243,24 @@ Network::Netresult_old Network::get_output(
         m_nncache.insert(state->board.get_hash(), result);
     }
 */
-    return result;
 }
 
-Network::Netresult_old Network::get_output_internal(
-    NNPlanes & planes, bool selfcheck) {
+void Network::get_output_internal(
+    Workspace & ws, bool selfcheck) {
 //    assert(symmetry >= 0 && symmetry < NUM_SYMMETRIES);
     constexpr auto width = BOARD_SIZE;
     constexpr auto height = BOARD_SIZE;
 
 //    const auto input_data = gather_features(state, symmetry);
-    std::vector<float> input_data;
-    // Data layout is input_data[(c * height + h) * width + w]
-    input_data.reserve(INPUT_CHANNELS * width * height);
-
-    for (int c = 0; c < INPUT_CHANNELS; ++c) {
-        for (int h = 0; h < height; ++h) {
-            for (int w = 0; w < width; ++w) {
-                input_data.emplace_back(net_t(planes[c][h*B_SIZE + w]));
-            }
-        }
-    }
+    // Data layout is input_data[(c * height + h) * width + w], as written
+    // by set_dcnn_channels().
+    const auto& input_data = ws.input;
 	if ( 0 ) { float s=0; for (size_t i=0; i<input_data.size(); i++) s += input_data[i]; myprintf("input_data.size()=%d,sum=%f\n",input_data.size(),s); }
 
-
-    std::vector<float> policy_data(OUTPUTS_POLICY * width * height);
-    std::vector<float> value_data(OUTPUTS_VALUE * width * height);
+    auto& policy_data = ws.policy;
+    auto& value_data = ws.value;
+    policy_data.resize(OUTPUTS_POLICY * width * height);
+    value_data.resize(OUTPUTS_VALUE * width * height);
 #ifdef USE_OPENCL_SELFCHECK
     if (selfcheck) {
         m_forward_cpu->forward(input_data, policy_data, value_data);
@@ -918,13 +1268,26 @@ Network::Netresult_old Network::get_output_internal(
         m_forward->forward(input_data, policy_data, value_data);
     }
 #else
-    m_forward->forward(input_data, policy_data, value_data);
+    {
+        Trace::Scope trace("forward", "batch", 1);
+        const auto start = BatchScheduler::clock::now();
+        m_forward->forward(input_data, policy_data, value_data);
+        if (!m_forward->forms_batches()) {
+            m_forward->batch_scheduler().record(1, BatchScheduler::clock::now() - start);
+        }
+    }
     (void) selfcheck;
 #endif
 
 	if ( 0 ) { float s=0; for (size_t i=0; i<policy_data.size(); i++) s += policy_data[i]; myprintf("policy_data.size()=%d,sum=%f\n",policy_data.size(),s); }
 	if ( 0 ) { float s=0; for (size_t i=0; i<value_data.size();  i++) s += value_data[i];  myprintf("value_data.size() =%d,sum=%f\n",value_data.size(),s); }
 
+    get_output_head(ws);
+}
+
+void Network::get_output_head(Workspace & ws) {
+    auto& policy_data = ws.policy;
+    auto& value_data = ws.value;
     // Get the moves
 //    batchnorm<NUM_INTERSECTIONS>(OUTPUTS_POLICY, policy_data,  m_bn_pol_w1.data(), m_bn_pol_w2.data());
     batchnorm<B_AREA>(OUTPUTS_POLICY, policy_data,  m_bn_pol_w1.data(), m_bn_pol_w2.data());
@@ -933,21 +1296,18 @@ Network::Netresult_old Network::get_output_internal(
 //            policy_data, m_ip_pol_w, m_ip_pol_b);
 //    const auto outputs = softmax(policy_out, cfg_softmax_temp);
 
-    std::vector<float> policy_out(POLICY_OUT_NUM);
-    convolve<1>(139, policy_data, m_conv2_pol_w, m_conv2_pol_b, policy_out);	// 9*9*139 = 11259
-    const auto outputs = softmax(policy_out, cfg_softmax_temp);
-//    softmax(policy_out, softmax_data, cfg_softmax_temp);
-//    std::vector<float>& outputs = softmax_data;
+    // The last 1x1 convolution (9*9*139 = 11259) is left to
+    // get_legal_policy(), which needs only the legal moves.
 
 
     // Now get the value
 //    batchnorm<NUM_INTERSECTIONS>(OUTPUTS_VALUE, value_data, m_bn_val_w1.data(), m_bn_val_w2.data());
     batchnorm<B_AREA>(OUTPUTS_VALUE, value_data, m_bn_val_w1.data(), m_bn_val_w2.data());
-    const auto winrate_data =
+    auto& winrate_data = ws.winrate_data;
+    auto& winrate_out = ws.winrate_out;
 //        innerproduct<OUTPUTS_VALUE * NUM_INTERSECTIONS, VALUE_LAYER, true>( value_data, m_ip1_val_w, m_ip1_val_b);
-        innerproduct<OUTPUTS_VALUE * B_AREA, VALUE_LAYER, true>( value_data, m_ip1_val_w, m_ip1_val_b);
-    const auto winrate_out =
-        innerproduct<VALUE_LAYER, 1, false>(winrate_data, m_ip2_val_w, m_ip2_val_b);
+    innerproduct<OUTPUTS_VALUE * B_AREA, VALUE_LAYER, true>( value_data, m_ip1_val_w, m_ip1_val_b, winrate_data);
+    innerproduct<VALUE_LAYER, 1, false>(winrate_data, m_ip2_val_w, m_ip2_val_b, winrate_out);
 
 
     // Map TanH output range [-1..1] to [0..1] range
@@ -964,20 +1324,43 @@ Network::Netresult_old Network::get_output_internal(
     result.policy_pass = outputs[NUM_INTERSECTIONS];
     result.winrate = winrate;
 */
-    std::vector<scored_node> result;
-    for (auto idx = size_t{0}; idx < outputs.size(); idx++) {
-//      if ( idx < 100 ) myprintf("%3d:%f\n",idx,outputs[idx]);
-//    myprintf("done tanh....%d,outputs.size()=%d\n",__LINE__,outputs.size());
-//		float v = outputs[idx];
-//    myprintf("done tanh....%d,v=%f\n",__LINE__,v);
-//        result.emplace_back(v, idx);
-        result.emplace_back(outputs[idx], idx);
-    }
-//  myprintf("done net calc\n");
-
-    return std::make_pair(result, winrate_sig);
+    // The features change places with the previous result, so neither
+    // buffer is reallocated.
+    std::swap(ws.result.first, policy_data);
+    ws.result.second = winrate_sig;
 //    return result;
 }
+
+void Network::get_legal_policy(const std::vector<float>& features,
+                               const std::vector<int>& ids,
+                               std::vector<float>& policy) const {
+    // id = c * 81 + square, as the output planes of the 1x1 convolution
+    policy.resize(ids.size());
+    for (auto i = size_t{0}; i < ids.size(); i++) {
+        const auto c = ids[i] / B_AREA;
+        const auto square = ids[i] % B_AREA;
+        const auto w = &m_conv2_pol_w[c * OUTPUTS_POLICY];
+        auto sum = m_conv2_pol_b[c];
+        for (auto k = 0; k < OUTPUTS_POLICY; k++) {
+            sum += w[k] * features[k * B_AREA + square];
+        }
+        policy[i] = sum;
+    }
+    if (policy.empty()) {
+        return;
+    }
+
+    // softmax(), in place
+    const auto alpha = *std::max_element(cbegin(policy), cend(policy));
+    auto denom = 0.0f;
+    for (auto& val : policy) {
+        val = std::exp((val - alpha) / cfg_softmax_temp);
+        denom += val;
+    }
+    for (auto& val : policy) {
+        val /= denom;
+    }
+}
 /*
 void Network::show_heatmap(const FastState* const state,
                            const Netresult& result,
@@ -1164,12 +1547,14 @@ void Network::nncache_resize(int max_count) {
 
 
 
-Network::Netresult_old Network::get_scored_moves_yss_zero(float data[][B_SIZE][B_SIZE]) {
-    Netresult_old result;
-    NNPlanes planes;
-    gather_features_yss_zero(planes, data);
+Network::Workspace& Network::get_workspace() {
+    static thread_local Workspace s_workspace;
+    s_workspace.input.resize(INPUT_CHANNELS * B_AREA);
+    return s_workspace;
+}
 
-	result = get_output( planes );
+void Network::get_scored_moves_yss_zero(Workspace & ws) {
+	get_output( ws );
 //    result = get_scored_moves_internal(NULL, planes, 0);
 /*
 	auto net_eval = result.second;
@@ -1185,7 +1570,70 @@ Network::Netresult_old Network::get_scored_moves_yss_zero(float data[][B_SIZE][B
     }
 //  myprintf("legal_sum=%f\n",legal_sum);
 */
-    return result;
+}
+
+// Evaluates several positions with one forward_batch() call.
+// The layout of each data[] is the same as Workspace::input.
+std::vector<Network::Netresult_head> Network::get_scored_moves_yss_zero_batch(
+    const std::vector<float*>& data) {
+    constexpr auto in_size = INPUT_CHANNELS * B_AREA;
+    constexpr auto pol_size = OUTPUTS_POLICY * B_AREA;
+    constexpr auto val_size = OUTPUTS_VALUE * B_AREA;
+    const auto batch_size = data.size();
+
+    std::vector<Netresult_head> results;
+    if (batch_size == 0) {
+        return results;
+    }
+    auto& ws = get_workspace();
+    auto& input_data = ws.batch_input;
+    auto& policy_batch = ws.batch_policy;
+    auto& value_batch = ws.batch_value;
+    input_data.resize(in_size * batch_size);
+    policy_batch.resize(pol_size * batch_size);
+    value_batch.resize(val_size * batch_size);
+    for (auto b = size_t{0}; b < batch_size; b++) {
+        std::copy(data[b], data[b] + in_size, begin(input_data) + b * in_size);
+    }
+    {
+        Trace::Scope trace("forward", "batch", static_cast<int>(batch_size));
+        const auto start = BatchScheduler::clock::now();
+        m_forward->forward_batch(input_data, policy_batch, value_batch, batch_size);
+        if (!m_forward->forms_batches()) {
+            m_forward->batch_scheduler().record(batch_size,
+                                                BatchScheduler::clock::now() - start);
+        }
+    }
+
+    // The results are kept until used, so each takes its own features.
+    results.reserve(batch_size);
+    for (auto b = size_t{0}; b < batch_size; b++) {
+        ws.policy.assign(begin(policy_batch) + b * pol_size,
+                         begin(policy_batch) + (b + 1) * pol_size);
+        ws.value.assign(begin(value_batch) + b * val_size,
+                        begin(value_batch) + (b + 1) * val_size);
+        get_output_head(ws);
+        results.emplace_back(std::move(ws.result));
+    }
+    return results;
+}
+
+size_t Network::get_batch_target() const {
+    return m_forward->batch_scheduler().target();
+}
+
+bool Network::forms_batches() const {
+    return m_forward->forms_batches();
+}
+
+size_t Network::get_idle_batch_slots() const {
+    const auto target = m_forward->batch_scheduler().target();
+    const auto queued = m_forward->queued() + 1;
+    return (queued < target) ? target - queued : 0;
+}
+
+std::string Network::get_batch_stats() const {
+    return m_forward->batch_scheduler().stats();
 }
 
 void Network::gather_features_yss_zero(NNPlanes & planes, float data[][B_SIZE][B_SIZE]) {
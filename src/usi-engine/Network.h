@@ -36,6 +36,7 @@
 
 #include <deque>
 #include <array>
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <utility>
@@ -49,6 +50,7 @@
 #endif
 #include "GameState.h"
 #include "ForwardPipe.h"
+#include "Winograd.h"
 #ifdef USE_OPENCL
 #include "OpenCLScheduler.h"
 #endif
@@ -56,14 +58,7 @@
 #include "SMP.h"
 #endif
 
-
-// Winograd filter transformation changes 3x3 filters to M + 3 - 1
-constexpr auto WINOGRAD_M = 4;
-constexpr auto WINOGRAD_ALPHA = WINOGRAD_M + 3 - 1;
-constexpr auto WINOGRAD_WTILES = BOARD_SIZE / WINOGRAD_M + (BOARD_SIZE % WINOGRAD_M != 0);
-constexpr auto WINOGRAD_TILE = WINOGRAD_ALPHA * WINOGRAD_ALPHA;
-constexpr auto WINOGRAD_P = WINOGRAD_WTILES * WINOGRAD_WTILES;
-constexpr auto SQ2 = 1.4142135623730951f; // Square root of 2
+class CPUPipeInt8;
 
 class Network {
     using ForwardPipeWeights = ForwardPipe::ForwardPipeWeights;
@@ -78,6 +73,31 @@ public:
 
     using scored_node = std::pair<float, int>;
     using Netresult_old = std::pair<std::vector<scored_node>, float>;
+    // Policy features before the last 1x1 convolution, [OUTPUTS_POLICY][B_AREA]
+    // with batchnorm applied, and the value. get_legal_policy() turns the
+    // features into priors of the legal moves.
+    using Netresult_head = std::pair<std::vector<float>, float>;
+
+    // Buffers of one search thread, kept between evaluations so that an
+    // evaluation allocates nothing. The caller writes the input planes
+    // in place, [INPUT_CHANNELS][B_AREA].
+    struct Workspace {
+        std::vector<float> input;
+        std::vector<float> policy;
+        std::vector<float> value;
+        std::vector<float> winrate_data;
+        std::vector<float> winrate_out;
+        Netresult_head result;
+        // legal move ids and their priors, see get_legal_policy()
+        std::vector<int> ids;
+        std::vector<float> legal;
+        // get_scored_moves_yss_zero_batch()
+        std::vector<float> batch_input;
+        std::vector<float> batch_policy;
+        std::vector<float> batch_value;
+    };
+    // one per thread, like Random::get_Rng()
+    static Workspace& get_workspace();
 
     using BoardPlane = std::array<float, 9*9>;
     using NNPlanes = std::vector<BoardPlane>;
@@ -91,7 +111,7 @@ public:
 //                         const bool read_cache = true,
 //                         const bool write_cache = true,
 //                         const bool force_selfcheck = false);
-    Netresult_old get_output(NNPlanes & planes,
+    void get_output(Workspace & ws,
                          const bool force_selfcheck = false);
 
     static constexpr auto INPUT_MOVES = 8;
@@ -110,7 +130,12 @@ public:
 //    static constexpr auto VALUE_HEAD_CONV1_SIZE  = OUTPUTS_VALUE;
 
 
-    void initialize(int playouts, const std::string & weightsfile);
+    // weights_crc64, if known, is that of the decoded weights. A CPU
+    // engine then finds its weight cache without reading the file.
+    void initialize(int playouts, const std::string & weightsfile,
+                    const std::string & int8file = std::string(),
+                    std::uint64_t weights_crc64 = 0);
+    bool save_int8_calibration();
 
     float benchmark_time(int centiseconds);
     void benchmark(const GameState * const state,
@@ -128,14 +153,36 @@ public:
     size_t get_estimated_cache_size();
     void nncache_resize(int max_count);
 
-    Netresult_old get_scored_moves_yss_zero(float data[][9][9]);
+    // ws.input -> ws.result
+    void get_scored_moves_yss_zero(Workspace & ws);
+    std::vector<Netresult_head> get_scored_moves_yss_zero_batch(
+        const std::vector<float*>& data);
+    // batch size the search should form for get_scored_moves_yss_zero_batch()
+    size_t get_batch_target() const;
+    // ForwardPipe::forms_batches() of the pipe
+    bool forms_batches() const;
+    // positions the next batch of the target size would run without,
+    // besides one more forward() call
+    size_t get_idle_batch_slots() const;
+    // BatchScheduler::stats() of the pipe
+    std::string get_batch_stats() const;
+    // Softmax over the policy logits of the given move ids only, in the
+    // same order. A logit is one dot product of the features at the
+    // move's square, so ~80 legal moves cost a fraction of all 11259.
+    void get_legal_policy(const std::vector<float>& features,
+                          const std::vector<int>& ids,
+                          std::vector<float>& policy) const;
     static void gather_features_yss_zero(NNPlanes& planes, float data[][9][9]);
     static Netresult_old get_scored_moves_internal(
       const GameState* state, NNPlanes & planes, int rotation);
 
 private:
-    std::pair<int, int> load_v1_network(std::istream& wtfile);
+    std::pair<int, int> load_v1_network(std::deque<std::vector<float>>& lines);
     std::pair<int, int> load_network_file(const std::string& filename);
+    std::pair<int, int> load_binary_network(const std::string& filename);
+    std::pair<int, int> load_binary_network(const char *data, size_t size);
+    void set_weights_line(const size_t linecount, const size_t plain_conv_wts,
+                          std::vector<float>& weights);
 
     static std::vector<float> winograd_transform_f(const std::vector<float>& f,
                                                    const int outputs, const int channels);
@@ -160,7 +207,9 @@ private:
 //    Netresult get_output_internal(const GameState* const state,
 //    Netresult_old get_output_internal(const GameState* const state,
 //                                  const int symmetry, bool selfcheck = false);
-    Netresult_old get_output_internal( NNPlanes & planes, bool selfcheck = false);
+    void get_output_internal( Workspace & ws, bool selfcheck = false);
+    // ws.policy and ws.value -> ws.result
+    void get_output_head(Workspace & ws);
     static void fill_input_plane_pair(const FullBoard& board,
                                       std::vector<float>::iterator black,
                                       std::vector<float>::iterator white,
@@ -170,14 +219,23 @@ private:
 //                                            std::unique_ptr<ForwardPipe>&& pipe);
     std::unique_ptr<ForwardPipe> init_net(int channels,
                                             std::unique_ptr<ForwardPipe> pipe);
+    std::unique_ptr<ForwardPipe> init_int8(int channels,
+                                           const std::string & int8file);
+    // The heads evaluated here, stored next to the weight cache of the
+    // CPUPipe. init_from_cache() sets up the CPU engine from the two
+    // files alone.
+    void store_cache(std::uint64_t crc64, int channels, int residual_blocks);
+    bool init_from_cache(std::uint64_t crc64);
 
 #ifdef USE_HALF
     void select_precision(int channels);
 #endif
     std::unique_ptr<ForwardPipe> m_forward;
+    // set when m_forward is the INT8 pipe
+    CPUPipeInt8 * m_int8{nullptr};
 #ifdef USE_OPENCL_SELFCHECK
 //    void compare_net_outputs(const Netresult& data, const Netresult& ref);
-    void compare_net_outputs(std::vector<scored_node>& data, std::vector<scored_node>& ref);
+    void compare_net_outputs(std::vector<float>& data, std::vector<float>& ref);
     std::unique_ptr<ForwardPipe> m_forward_cpu;
 #endif
 
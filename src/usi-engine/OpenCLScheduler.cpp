@@ -37,6 +37,7 @@
 #include "Network.h"
 #include "Utils.h"
 #include "OpenCLScheduler.h"
+#include "Trace.h"
 
 using Utils::ceilMultiple;
 using Utils::myprintf;
@@ -277,14 +278,50 @@ void OpenCLScheduler<net_t>::forward(const std::vector<float>& input,
         std::unique_lock<std::mutex> lk(m_mutex);
         m_forward_queue.push_back(entry);
 
+        m_batch_scheduler.arrival();
         if (m_single_eval_in_progress.load()) {
-            m_waittime += 2;
+            m_batch_scheduler.single_eval_too_early();
         }
     }
     m_cv.notify_one();
     entry->cv.wait(lk);
 }
 
+template <typename net_t>
+size_t OpenCLScheduler<net_t>::queued() {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_forward_queue.size();
+}
+
+// Each position is queued as its own entry, so batch_worker() can pack them
+// into one OpenCL batch together with other pending requests.
+template <typename net_t>
+void OpenCLScheduler<net_t>::forward_batch(const std::vector<float>& input,
+                                           std::vector<float>& output_pol,
+                                           std::vector<float>& output_val,
+                                           const size_t batch_size) {
+    const auto in_size = input.size() / batch_size;
+    const auto pol_size = output_pol.size() / batch_size;
+    const auto val_size = output_val.size() / batch_size;
+    std::vector<std::vector<float>> in(batch_size);
+    std::vector<std::vector<float>> pol(batch_size, std::vector<float>(pol_size));
+    std::vector<std::vector<float>> val(batch_size, std::vector<float>(val_size));
+
+    Utils::ThreadGroup tg(thread_pool);
+    for (auto b = size_t{0}; b < batch_size; b++) {
+        in[b].assign(begin(input) + b * in_size, begin(input) + (b + 1) * in_size);
+        tg.add_task([this, &in, &pol, &val, b]() {
+            forward(in[b], pol[b], val[b]);
+        });
+    }
+    tg.wait_all();
+
+    for (auto b = size_t{0}; b < batch_size; b++) {
+        std::copy(begin(pol[b]), end(pol[b]), begin(output_pol) + b * pol_size);
+        std::copy(begin(val[b]), end(val[b]), begin(output_val) + b * val_size);
+    }
+}
+
 #ifndef NDEBUG
 struct batch_stats_t batch_stats;
 #endif
@@ -299,23 +336,18 @@ void OpenCLScheduler<net_t>::batch_worker(const size_t gnum) {
 
     // batch scheduling heuristic.
     // Returns the batch picked up from the queue (m_forward_queue)
-    // 1) Wait for m_waittime milliseconds for full batch
+    // 1) Wait for m_batch_scheduler.wait_time() for a batch of its target size
     // 2) if we don't have a full batch then just do a single eval
     //
-    // The purpose of m_waittime is to prevent the system from deadlocking
-    // because we were waiting for a job too long, while the job is never
-    // going to come due to a control dependency (e.g., evals stuck on a
-    // critical path).  To do so:
-    //
-    // 1) if we couldn't form a batch after waiting m_waittime ms, it means
-    // that we hit the critical path and should do scalar evals.
-    // Wait 1ms shorter next time.
-    //
-    // 2) if we picked up a single eval, but were getting additional evals
-    // while that single eval was being processed, it means that we made
-    // the wrong decision.  Wait 2ms longer next time.
+    // The wait prevents the system from deadlocking because we were
+    // waiting for a job too long, while the job is never going to come
+    // due to a control dependency (e.g., evals stuck on a critical path).
+    // BatchScheduler shortens it after a single eval, lengthens it when
+    // evals arrived during one, and keeps it to what the arrivals need
+    // to fill the batch. See BatchScheduler.h.
 
     auto pickup_task = [this] () {
+        Trace::Scope trace("batch_wait");
         std::list<std::shared_ptr<ForwardQueueEntry>> inputs;
         size_t count = 0;
 
@@ -323,17 +355,18 @@ void OpenCLScheduler<net_t>::batch_worker(const size_t gnum) {
         while (true) {
             if (!m_running) return inputs;
 
+            const auto target = m_batch_scheduler.target();
             count = m_forward_queue.size();
-            if (count >= cfg_batch_size) {
-                count = cfg_batch_size;
+            if (count >= target) {
+                count = target;
                 break;
             }
 
             bool timeout = !m_cv.wait_for(
                 lk,
-                std::chrono::milliseconds(m_waittime),
-                [this] () {
-                    return !m_running || m_forward_queue.size() >= cfg_batch_size;
+                m_batch_scheduler.wait_time(count),
+                [this, target] () {
+                    return !m_running || m_forward_queue.size() >= target;
                 }
             );
 
@@ -342,9 +375,7 @@ void OpenCLScheduler<net_t>::batch_worker(const size_t gnum) {
                     // Waited long enough but couldn't form a batch.
                     // Check if there is any other single eval in progress, and if not,
                     // do one from this thread.
-                    if (m_waittime > 1) {
-                        m_waittime--;
-                    }
+                    m_batch_scheduler.timed_out();
                     count = 1;
                     break;
                 }
@@ -393,8 +424,13 @@ void OpenCLScheduler<net_t>::batch_worker(const size_t gnum) {
         }
 
         // run the NN evaluation
-        m_networks[gnum]->forward(
-            batch_input, batch_output_pol, batch_output_val, context, count);
+        {
+            Trace::Scope trace("batch_forward", "batch", count);
+            const auto start = BatchScheduler::clock::now();
+            m_networks[gnum]->forward(
+                batch_input, batch_output_pol, batch_output_val, context, count);
+            m_batch_scheduler.record(count, BatchScheduler::clock::now() - start);
+        }
 
         // Get output and copy back
         index = 0;
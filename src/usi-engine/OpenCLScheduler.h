@@ -71,7 +71,13 @@ public:
     virtual void forward(const std::vector<float>& input,
                          std::vector<float>& output_pol,
                          std::vector<float>& output_val);
+    virtual void forward_batch(const std::vector<float>& input,
+                               std::vector<float>& output_pol,
+                               std::vector<float>& output_val,
+                               const size_t batch_size);
     virtual bool needs_autodetect();
+    virtual bool forms_batches() const { return true; }
+    virtual size_t queued();
     virtual void push_weights(unsigned int filter_size,
                               unsigned int channels,
                               unsigned int outputs,
@@ -84,9 +90,6 @@ private:
     std::mutex m_mutex;
     std::condition_variable m_cv;
 
-    // start with 10 milliseconds : lock protected
-    int m_waittime{10};
-
     // set to true when single (non-batch) eval is in progress
     std::atomic<bool> m_single_eval_in_progress{false};
 
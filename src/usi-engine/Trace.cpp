@@ -0,0 +1,110 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "config.h"
+#include "Trace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Utils.h"
+
+using namespace Utils;
+
+std::atomic<bool> Trace::enabled{false};
+
+namespace {
+    struct Event {
+        const char *name;
+        const char *arg_name;
+        int arg;
+        Trace::clock::time_point start;
+        Trace::clock::time_point end;
+    };
+
+    // events per thread. older events are overwritten when it is full.
+    constexpr size_t RING_SIZE = 1 << 18;
+
+    struct Ring {
+        int tid;
+        std::atomic<size_t> count{0};
+        std::vector<Event> events;
+    };
+
+    std::mutex g_mutex;     // only for adding a new thread
+    std::vector<std::unique_ptr<Ring>> g_rings;
+    std::string g_filename;
+    Trace::clock::time_point g_origin;
+    thread_local Ring *t_ring = nullptr;
+
+    Ring *get_ring() {
+        if (t_ring == nullptr) {
+            auto ring = std::make_unique<Ring>();
+            ring->events.resize(RING_SIZE);
+            std::lock_guard<std::mutex> lock(g_mutex);
+            ring->tid = static_cast<int>(g_rings.size()) + 1;
+            t_ring = ring.get();
+            g_rings.emplace_back(std::move(ring));
+        }
+        return t_ring;
+    }
+
+    double to_us(Trace::clock::duration d) {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+}
+
+void Trace::open(const std::string& filename) {
+    g_filename = filename;
+    g_origin = clock::now();
+    enabled = true;
+    std::atexit(Trace::close);
+}
+
+void Trace::record(const char *name, const char *arg_name, int arg,
+                   clock::time_point start, clock::time_point end) {
+    auto ring = get_ring();
+    auto n = ring->count.load(std::memory_order_relaxed);
+    auto& e = ring->events[n % RING_SIZE];
+    e.name = name;
+    e.arg_name = arg_name;
+    e.arg = arg;
+    e.start = start;
+    e.end = end;
+    ring->count.store(n + 1, std::memory_order_release);
+}
+
+void Trace::close() {
+    if (!enabled.exchange(false)) {
+        return;
+    }
+    auto fp = fopen(g_filename.c_str(), "w");
+    if (fp == nullptr) {
+        myprintf_error("Could not write trace file %s\n", g_filename.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    size_t total = 0;
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (const auto& ring : g_rings) {
+        auto n = ring->count.load(std::memory_order_acquire);
+        auto first = n > RING_SIZE ? n - RING_SIZE : 0;
+        for (auto i = first; i < n; i++) {
+            const auto& e = ring->events[i % RING_SIZE];
+            fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    total ? ",\n" : "", e.name, ring->tid,
+                    to_us(e.start - g_origin), to_us(e.end - e.start));
+            if (e.arg_name) {
+                fprintf(fp, ",\"args\":{\"%s\":%d}", e.arg_name, e.arg);
+            }
+            fprintf(fp, "}");
+            total++;
+        }
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+    myprintf("Wrote %zu trace events to %s\n", total, g_filename.c_str());
+}
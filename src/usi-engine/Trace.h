@@ -0,0 +1,51 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef TRACE_H_INCLUDED
+#define TRACE_H_INCLUDED
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Event tracing in Chrome Trace Event format ("--trace file.json").
+// Open the file with chrome://tracing or https://ui.perfetto.dev
+//
+// Each thread records complete events ("ph":"X") into its own ring buffer
+// without locking, and all buffers are written out at exit. When tracing is
+// disabled, a Scope costs one relaxed atomic load.
+namespace Trace {
+    using clock = std::chrono::steady_clock;
+
+    extern std::atomic<bool> enabled;
+
+    void open(const std::string& filename);
+    void close();
+    void record(const char *name, const char *arg_name, int arg,
+                clock::time_point start, clock::time_point end);
+
+    class Scope {
+    public:
+        explicit Scope(const char *name,
+                       const char *arg_name = nullptr, int arg = 0)
+            : m_name(enabled.load(std::memory_order_relaxed) ? name : nullptr),
+              m_arg_name(arg_name), m_arg(arg) {
+            if (m_name) {
+                m_start = clock::now();
+            }
+        }
+        ~Scope() {
+            if (m_name) {
+                record(m_name, m_arg_name, m_arg, m_start, clock::now());
+            }
+        }
+        void set_arg(int arg) { m_arg = arg; }
+
+    private:
+        const char *m_name;
+        const char *m_arg_name;
+        int m_arg;
+        clock::time_point m_start;
+    };
+}
+
+#endif
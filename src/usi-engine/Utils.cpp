@@ -32,19 +32,25 @@
 #include "config.h"
 #include "Utils.h"
 
+#include <array>
 #include <mutex>
 #include <cstdarg>
 #include <cstdio>
 
 #include <boost/filesystem.hpp>
 #include <boost/math/distributions/students_t.hpp>
+#include <lzma.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
+#include <pthread.h>
 #include <sys/select.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <pwd.h>
 #endif
 
@@ -214,6 +220,92 @@ size_t Utils::ceilMultiple(size_t a, size_t b) {
     return ret;
 }
 
+bool Utils::set_thread_affinity(int cpu) {
+#if defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+std::uint64_t Utils::crc64(const void *p, size_t len, std::uint64_t crc) {
+    // liblzma's is sliced, several times the speed of a byte table
+    return lzma_crc64(static_cast<const std::uint8_t *>(p), len, crc);
+}
+
+bool Utils::MappedFile::open(const std::string& filename) {
+    close();
+#ifdef _WIN32
+    auto file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+    auto mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping == nullptr) {
+        CloseHandle(file);
+        return false;
+    }
+    auto data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (data == nullptr) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_data = static_cast<const char *>(data);
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    const auto fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) < 0 || sb.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+    const auto size = static_cast<size_t>(sb.st_size);
+    auto data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    m_data = static_cast<const char *>(data);
+    m_size = size;
+#endif
+    return true;
+}
+
+void Utils::MappedFile::close() {
+    if (m_data == nullptr) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(m_data);
+    CloseHandle(m_mapping);
+    CloseHandle(m_file);
+    m_file = nullptr;
+    m_mapping = nullptr;
+#else
+    munmap(const_cast<char *>(m_data), m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+}
+
 const std::string Utils::leelaz_file(std::string file) {
 #if defined(_WIN32) || defined(__ANDROID__)
     boost::filesystem::path dir(boost::filesystem::current_path());
@@ -33,6 +33,7 @@
 #include "config.h"
 
 #include <atomic>
+#include <cstdint>
 #include <limits>
 #include <string>
 
@@ -66,6 +67,34 @@ namespace Utils {
 
     size_t ceilMultiple(size_t a, size_t b);
 
+    // Pins the calling thread to one logical CPU. false if not supported.
+    bool set_thread_affinity(int cpu);
+
+    // CRC-64/XZ by lzma_crc64(), the same value as autousi and server
+    std::uint64_t crc64(const void *p, size_t len, std::uint64_t crc = 0);
+
+    // A whole file mapped read-only into memory
+    class MappedFile {
+    public:
+        MappedFile() = default;
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        bool open(const std::string& filename);
+        void close();
+        const char *data() const { return m_data; }
+        size_t size() const { return m_size; }
+
+    private:
+        const char *m_data{nullptr};
+        size_t m_size{0};
+#ifdef _WIN32
+        void *m_file{nullptr};
+        void *m_mapping{nullptr};
+#endif
+    };
+
     const std::string leelaz_file(std::string file);
 
     void create_z_table();
@@ -0,0 +1,162 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "config.h"
+#include "WeightCache.h"
+
+#include <cinttypes>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/sync/file_lock.hpp>
+
+#include "Utils.h"
+
+using Utils::myprintf;
+
+namespace {
+    constexpr char cache_magic[8] = { 'A', 'O', 'B', 'A', 'W', 'C', 'C', 'H' };
+    // Raise whenever a pipe changes what or how it adds.
+    constexpr auto cache_version = std::uint32_t{1};
+    constexpr auto cache_align = size_t{64};
+
+    // followed by the size in bytes of each array, then the arrays, each
+    // at a multiple of cache_align
+    struct CacheHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t sections;
+        std::uint64_t crc64;
+        char padding[40];
+    };
+    static_assert(sizeof(CacheHeader) == 64, "CacheHeader must be 64 bytes");
+
+    size_t cache_align_up(const size_t n) {
+        return (n + cache_align - 1) / cache_align * cache_align;
+    }
+}
+
+WeightCache::WeightCache(const std::string& dir, const std::uint64_t crc64,
+                         const std::string& key)
+    : m_crc64(crc64) {
+    if (dir.empty()) {
+        return;
+    }
+    char name[32];
+    std::snprintf(name, sizeof(name), "w%016" PRIx64 "-", crc64);
+    m_filename = (boost::filesystem::path(dir) / (name + key + ".cache")).string();
+}
+
+bool WeightCache::load() {
+    m_file.close();
+    m_sections.clear();
+    if (!enabled() || !boost::filesystem::exists(m_filename)
+        || !m_file.open(m_filename)) {
+        return false;
+    }
+    const auto data = m_file.data();
+    const auto size = m_file.size();
+
+    CacheHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) != 0
+        || header.version != cache_version || header.crc64 != m_crc64
+        || size < sizeof(header) + header.sections * sizeof(std::uint64_t)) {
+        return false;
+    }
+
+    m_sections.clear();
+    auto offset = cache_align_up(sizeof(header)
+                                 + header.sections * sizeof(std::uint64_t));
+    for (auto i = size_t{0}; i < header.sections; i++) {
+        std::uint64_t bytes;
+        std::memcpy(&bytes, data + sizeof(header) + i * sizeof(bytes), sizeof(bytes));
+        // store() pads only between the arrays, so the aligned offset of
+        // an array may pass the end of a corrupt file
+        if (offset > size || bytes > size - offset) {
+            return false;
+        }
+        m_sections.emplace_back(offset, bytes);
+        offset = cache_align_up(offset + bytes);
+    }
+    m_next = 0;
+    return true;
+}
+
+void WeightCache::store() {
+    if (!enabled()) {
+        return;
+    }
+    auto header = CacheHeader{};
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.sections = static_cast<std::uint32_t>(m_add.size());
+    header.crc64 = m_crc64;
+
+    // unique, as other engines may write the same file at the same time
+    auto tmpname = std::string{};
+    try {
+        tmpname = boost::filesystem::unique_path(m_filename + ".%%%%%%%%.tmp").string();
+        boost::filesystem::create_directories(
+            boost::filesystem::path(m_filename).parent_path());
+        auto ofs = std::ofstream{tmpname, std::ios::binary | std::ios::trunc};
+        ofs.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        for (const auto& a : m_add) {
+            const auto bytes = std::uint64_t{a.second};
+            ofs.write(reinterpret_cast<const char *>(&bytes), sizeof(bytes));
+        }
+        const char zeros[cache_align] = {};
+        auto offset = sizeof(header) + m_add.size() * sizeof(std::uint64_t);
+        for (const auto& a : m_add) {
+            ofs.write(zeros, cache_align_up(offset) - offset);
+            offset = cache_align_up(offset);
+            ofs.write(static_cast<const char *>(a.first), a.second);
+            offset += a.second;
+        }
+        ofs.close();
+        if (!ofs) {
+            throw std::runtime_error("write failed");
+        }
+        boost::filesystem::rename(tmpname, m_filename);
+        myprintf("Wrote weight cache %s.\n", m_filename.c_str());
+    } catch (const std::exception& e) {
+        myprintf("Could not write weight cache %s: %s\n",
+                 m_filename.c_str(), e.what());
+        if (!tmpname.empty()) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(tmpname, ec);
+        }
+    }
+    m_add.clear();
+    m_counts.clear();
+}
+
+WeightCache::Lock::Lock(const WeightCache& cache) {
+    if (!cache.enabled()) {
+        return;
+    }
+    const auto name = cache.filename() + ".lock";
+    try {
+        boost::filesystem::create_directories(
+            boost::filesystem::path(name).parent_path());
+        std::ofstream(name, std::ios::app);
+        m_lock = std::make_unique<boost::interprocess::file_lock>(name.c_str());
+        if (!m_lock->try_lock()) {
+            myprintf("Waiting for another engine to write %s.\n",
+                     cache.filename().c_str());
+            m_lock->lock();
+        }
+    } catch (const std::exception& e) {
+        myprintf("Could not lock %s: %s\n", name.c_str(), e.what());
+        m_lock.reset();
+    }
+}
+
+WeightCache::Lock::~Lock() {
+    if (m_lock) {
+        m_lock->unlock();
+    }
+}
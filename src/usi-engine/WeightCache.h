@@ -0,0 +1,171 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef WEIGHTCACHE_H_INCLUDED
+#define WEIGHTCACHE_H_INCLUDED
+#include "config.h"
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Utils.h"
+
+namespace boost { namespace interprocess { class file_lock; } }
+
+// A read-only array owned elsewhere: a std::vector of the pipe, or a
+// mapped WeightCache file
+template <typename T>
+class WeightArray {
+public:
+    WeightArray() = default;
+    WeightArray(const T *data, size_t size) : m_data(data), m_size(size) {}
+    WeightArray(const std::vector<T>& v) : m_data(v.data()), m_size(v.size()) {}
+
+    const T *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+    const T *m_data{nullptr};
+    size_t m_size{0};
+};
+
+// Weights as a pipe leaves them after push_weights (transformed, folded,
+// packed), kept in a directory between runs. The file name holds the
+// CRC64 of the weights file and a key with everything else the result
+// depends on, so any change misses the cache instead of reading stale
+// data. A pipe adds its arrays in a fixed order and reads them back in
+// the same order, either copied or in place. The file is mapped
+// read-only, so all engines of a host using it in place share one copy
+// in the page cache.
+class WeightCache {
+public:
+    // An empty dir disables the cache.
+    WeightCache(const std::string& dir, std::uint64_t crc64,
+                const std::string& key);
+
+    bool enabled() const { return !m_filename.empty(); }
+    const std::string& filename() const { return m_filename; }
+
+    // Maps the file, also after store(). false if there is none or it is
+    // not of this version.
+    bool load();
+
+    // The next array of the file, false at a size mismatch or the end.
+    template <typename T>
+    bool read(std::vector<T>& v) {
+        if (m_next >= m_sections.size()
+            || m_sections[m_next].second % sizeof(T) != 0) {
+            return false;
+        }
+        const auto& s = m_sections[m_next++];
+        v.resize(s.second / sizeof(T));
+        std::memcpy(v.data(), m_file.data() + s.first, s.second);
+        return true;
+    }
+    template <typename T, size_t N>
+    bool read(std::array<T, N>& a) {
+        if (m_next >= m_sections.size()
+            || m_sections[m_next].second != N * sizeof(T)) {
+            return false;
+        }
+        std::memcpy(a.data(), m_file.data() + m_sections[m_next++].first, N * sizeof(T));
+        return true;
+    }
+    template <typename T>
+    bool read(std::vector<std::vector<T>>& vv) {
+        auto count = std::vector<std::uint64_t>{};
+        if (!read(count) || count.size() != 1) {
+            return false;
+        }
+        vv.resize(count[0]);
+        for (auto& v : vv) {
+            if (!read(v)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Same as read(), pointing into the mapping, valid while this lives
+    template <typename T>
+    bool view(WeightArray<T>& a) {
+        if (m_next >= m_sections.size()
+            || m_sections[m_next].second % sizeof(T) != 0) {
+            return false;
+        }
+        const auto& s = m_sections[m_next++];
+        a = WeightArray<T>(reinterpret_cast<const T *>(m_file.data() + s.first),
+                           s.second / sizeof(T));
+        return true;
+    }
+    template <typename T>
+    bool view(std::vector<WeightArray<T>>& va) {
+        auto count = std::vector<std::uint64_t>{};
+        if (!read(count) || count.size() != 1) {
+            return false;
+        }
+        va.resize(count[0]);
+        for (auto& a : va) {
+            if (!view(a)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The arrays are not copied, they must live until store().
+    template <typename T>
+    void add(const std::vector<T>& v) {
+        m_add.emplace_back(v.data(), v.size() * sizeof(T));
+    }
+    template <typename T, size_t N>
+    void add(const std::array<T, N>& a) {
+        m_add.emplace_back(a.data(), N * sizeof(T));
+    }
+    template <typename T>
+    void add(const std::vector<std::vector<T>>& vv) {
+        m_counts.emplace_back(vv.size());
+        m_add.emplace_back(&m_counts.back(), sizeof(std::uint64_t));
+        for (const auto& v : vv) {
+            add(v);
+        }
+    }
+
+    // Writes a temporary file and renames it, so a reader never sees a
+    // partial file. Failures are reported and otherwise ignored.
+    void store();
+
+    // Held while preparing the weights for store(), so that engines
+    // started together wait for the first one and then load() its file
+    // instead of all preparing the same weights. The OS drops the lock
+    // if the engine dies. Does nothing if the lock file cannot be made.
+    class Lock {
+    public:
+        explicit Lock(const WeightCache& cache);
+        ~Lock();
+        Lock(const Lock&) = delete;
+        Lock& operator=(const Lock&) = delete;
+    private:
+        std::unique_ptr<boost::interprocess::file_lock> m_lock;
+    };
+
+private:
+    std::string m_filename;
+    std::uint64_t m_crc64;
+    Utils::MappedFile m_file;
+    // offset and size of each array in m_file
+    std::vector<std::pair<size_t, size_t>> m_sections;
+    size_t m_next{0};
+    std::vector<std::pair<const void *, size_t>> m_add;
+    // a deque, as m_add points into it
+    std::deque<std::uint64_t> m_counts;
+};
+
+#endif
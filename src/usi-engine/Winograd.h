@@ -0,0 +1,23 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#ifndef WINOGRAD_H_INCLUDED
+#define WINOGRAD_H_INCLUDED
+#include "config.h"
+
+// Winograd filter transformation changes 3x3 filters to M + 3 - 1
+constexpr auto WINOGRAD_M = 4;
+constexpr auto WINOGRAD_ALPHA = WINOGRAD_M + 3 - 1;
+constexpr auto WINOGRAD_WTILES = BOARD_SIZE / WINOGRAD_M + (BOARD_SIZE % WINOGRAD_M != 0);
+constexpr auto WINOGRAD_TILE = WINOGRAD_ALPHA * WINOGRAD_ALPHA;
+constexpr auto WINOGRAD_P = WINOGRAD_WTILES * WINOGRAD_WTILES;
+constexpr auto SQ2 = 1.4142135623730951f; // Square root of 2
+
+// F(3x3, 3x3) tiles the 9x9 board exactly with 5x5 input tiles (CPU only)
+constexpr auto WINOGRAD3_M = 3;
+constexpr auto WINOGRAD3_ALPHA = WINOGRAD3_M + 3 - 1;
+constexpr auto WINOGRAD3_WTILES = BOARD_SIZE / WINOGRAD3_M;
+constexpr auto WINOGRAD3_TILE = WINOGRAD3_ALPHA * WINOGRAD3_ALPHA;
+constexpr auto WINOGRAD3_P = WINOGRAD3_WTILES * WINOGRAD3_WTILES;
+static_assert(BOARD_SIZE % WINOGRAD3_M == 0, "F(3x3, 3x3) needs exact tiling");
+
+#endif
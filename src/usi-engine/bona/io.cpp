@@ -14,6 +14,7 @@
 #  include <unistd.h>
 #endif
 #include "shogi.h"
+#include "../Trace.h"
 
 #if defined(_MSC_VER)
 #  include <Share.h>
@@ -71,6 +72,7 @@ out( const char *format, ... )
 void CONV
 usi_out( const char *format, ... )
 {
+  Trace::Scope trace( "usi_out" );
   va_list arg;
 
   va_start( arg, format );
@@ -695,6 +697,7 @@ out_hand0( FILE *pf, int n, const char *str_prefix, const char *str )
 static int CONV
 read_command( char ** pstr_line_end )
 {
+  Trace::Scope trace( "usi_read" );
   char *str_end;
   int count_byte, count_cmdbuff;
 
@@ -60,6 +60,16 @@ main()
       return EXIT_SUCCESS;
     }
 
+#if defined(YSS_ZERO)
+  if ( get_cmdline_command() != NULL )
+    {
+      strncpy( str_cmdline, get_cmdline_command(), SIZE_CMDLINE-1 );
+      if ( procedure( ptree ) < 0 ) { out_error( "%s", str_error ); }
+      if ( fin() < 0 ) { out_error( "%s", str_error ); }
+      return EXIT_SUCCESS;
+    }
+#endif
+
   for ( ;; )
     {
       iret = main_child( ptree );
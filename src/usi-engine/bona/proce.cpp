@@ -58,6 +58,11 @@ static int CONV proce_usi( tree_t * restrict ptree );
 static int CONV usi_posi( tree_t * restrict ptree, char **lasts );
 static int CONV usi_go( tree_t * restrict ptree, char **lasts );
 static int CONV usi_ignore( tree_t * restrict ptree, char **lasts );
+#  if defined(YSS_ZERO)
+static int CONV usi_bench( tree_t * restrict ptree, char **lasts );
+static int CONV usi_records( tree_t * restrict ptree, char **lasts,
+			     int mode );
+#  endif
 #endif
 
 #if defined(TLP)
@@ -471,6 +476,12 @@ static int CONV proce_usi( tree_t * restrict ptree )
   }
 
   if ( ! strcmp( token, "position" ) ) { return usi_posi( ptree, &lasts ); }
+#if defined(YSS_ZERO)
+  if ( ! strcmp( token, "bench" ) )    { return usi_bench( ptree, &lasts ); }
+  if ( ! strcmp( token, "calib" ) )    { return usi_records( ptree, &lasts, nn_records_calib ); }
+  if ( ! strcmp( token, "nndump" ) )   { return usi_records( ptree, &lasts, nn_records_dump ); }
+  if ( ! strcmp( token, "nnbench" ) )  { return usi_records( ptree, &lasts, nn_records_bench ); }
+#endif
   if ( ! strcmp( token, "quit" ) )     { return cmd_quit(); }
   if ( ! strcmp( token, "d" ) ) {
 /*
@@ -660,6 +671,148 @@ usi_posi( tree_t * restrict ptree, char **lasts )
   return 1;
 }
 
+
+#  if defined(YSS_ZERO)
+/* bench [file]
+   each line of the file is "[position] startpos moves ...". */
+static int CONV
+usi_bench( tree_t * restrict ptree, char **lasts )
+{
+  const char *token;
+  char str_line[ SIZE_CMDLINE ];
+  char *ptr;
+  FILE *pf = NULL;
+  int i, iret = 1;
+
+  AbortDifficultCommand;
+
+  token = strtok_r( NULL, str_delimiters, lasts );
+  if ( token != NULL )
+    {
+      pf = file_open( token, "r" );
+      if ( pf == NULL ) { return -2; }
+    }
+
+  bench_start();
+  for ( i = 0;; i++ )
+    {
+      if ( pf != NULL )
+	{
+	  if ( fgets( str_line, SIZE_CMDLINE, pf ) == NULL ) { break; }
+	}
+      else {
+	if ( bench_positions[i] == NULL ) { break; }
+	strncpy( str_line, bench_positions[i], SIZE_CMDLINE-1 );
+	str_line[SIZE_CMDLINE-1] = '\0';
+      }
+      str_line[ strcspn( str_line, "\r\n" ) ] = '\0';
+
+      ptr = str_line + strspn( str_line, str_delimiters );
+      if ( *ptr == '\0' || *ptr == '#' ) { continue; }
+      if ( ! strncmp( ptr, "position", 8 ) ) { ptr += 8; }
+
+      iret = usi_posi( ptree, &ptr );
+      if ( iret < 0 ) { break; }
+      bench_search( ptree );
+    }
+  bench_end();
+
+  if ( pf != NULL && file_close( pf ) < 0 ) { return -1; }
+  return iret < 0 ? iret : 1;
+}
+
+
+/* calib file.csa ...           (aobaz -w file -q8 int8file calib ...)
+   nndump out.txt file.csa ...
+   nnbench out.txt file.csa ...  (aobaz -w file -b N nnbench ...)
+   evaluate every position of the CSA records. handicap games are skipped.
+   calib records the activation range for the INT8 weights, nndump
+   writes value and policy in the net-test format. nnbench keeps the
+   input planes of all positions, evaluates them in batches of 1..N,
+   prints the speed and latency of each batch size and writes the
+   results of batch size N like nndump. */
+static int CONV
+usi_records( tree_t * restrict ptree, char **lasts, int mode )
+{
+  record_t record;
+  const char *token;
+  char str_path[ SIZE_CMDLINE ];
+  char str_usi[ 8 ];
+  FILE *pf = NULL;
+  unsigned int move;
+  int iret = 1, istatus;
+
+  AbortDifficultCommand;
+
+  if ( mode == nn_records_calib && ! is_int8_calibrating() )
+    {
+      str_error = "calib needs aobaz -q8 file calib records.csa";
+      return -2;
+    }
+  if ( mode != nn_records_calib )
+    {
+      token = strtok_r( NULL, str_delimiters, lasts );
+      if ( token == NULL )
+	{
+	  str_error = str_bad_cmdline;
+	  return -2;
+	}
+      pf = file_open( token, "w" );
+      if ( pf == NULL ) { return -2; }
+    }
+
+  while ( iret >= 0
+	  && ( token = strtok_r( NULL, str_delimiters, lasts ) ) != NULL )
+    {
+      iret = record_open( &record, token, mode_read, NULL, NULL );
+      if ( iret < 0 ) { break; }
+
+      str_path[0] = '\0';
+      for ( ;; )
+	{
+	  istatus = in_CSA( ptree, &record, &move, flag_nomake_move );
+	  if ( istatus < 0 ) { iret = istatus; break; }
+	  if ( istatus == record_eof ) { break; }
+	  if ( istatus == record_misc && record.moves == 1
+	       && ( root_turn != min_posi_no_handicap.turn_to_move
+		    || HAND_B != min_posi_no_handicap.hand_black
+		    || HAND_W != min_posi_no_handicap.hand_white
+		    || memcmp( BOARD, min_posi_no_handicap.asquare,
+			       nsquare ) ) )
+	    {
+	      istatus = record_resign;
+	    }
+	  if ( istatus != record_misc )
+	    {
+	      /* skip to the next game */
+	      if ( istatus != record_next
+		   && record_wind( &record ) == record_eof ) { break; }
+	      str_path[0] = '\0';
+	      continue;
+	    }
+
+	  nn_records_position( ptree, str_path, pf, mode );
+	  if ( csa2usi( ptree, str_CSA_move(move), str_usi ) < 0
+	       || make_move_root( ptree, move, 0 ) < 0 )
+	    {
+	      iret = -2;
+	      break;
+	    }
+	  if ( strlen( str_path ) + 8 < SIZE_CMDLINE )
+	    {
+	      strcat( str_path, " " );
+	      strcat( str_path, str_usi );
+	    }
+	}
+      if ( record_close( &record ) < 0 ) { iret = -1; }
+    }
+
+  if ( nn_records_end( mode, pf ) < 0 && iret >= 0 ) { iret = -2; }
+  if ( pf != NULL && file_close( pf ) < 0 ) { return -1; }
+  return iret < 0 ? iret : 1;
+}
+#  endif
+
 #endif
 
 
@@ -1529,6 +1682,9 @@ static int CONV cmd_problem( tree_t * restrict ptree, char **lasts )
 
 static int CONV cmd_quit( void )
 {
+#if defined(YSS_ZERO)
+  send_search_stat_total();
+#endif
   game_status |= flag_quit;
   return 1;
 }
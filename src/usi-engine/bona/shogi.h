@@ -1445,6 +1445,16 @@ double calc_penalty( void );
 int YssZero_com_turn_start( tree_t * restrict ptree );
 int getCmdLineParam(int argc, char *argv[]);
 const char *get_cmd_line_ptr();
+const char *get_cmdline_command();
+extern const char *bench_positions[];
+void bench_start();
+int bench_search( tree_t * restrict ptree );
+void bench_end();
+int is_int8_calibrating();
+enum { nn_records_dump, nn_records_calib, nn_records_bench };
+void nn_records_position( tree_t * restrict ptree, const char *str_path, FILE *pf,
+			  int mode );
+int nn_records_end( int mode, FILE *pf );
 void init_seqence_hash();
 const int SEQUENCE_HASH_SIZE = 512;	// 2^n.   別手順できた同一局面を区別するため
 extern uint64_t sequence_hash_from_to[SEQUENCE_HASH_SIZE][81][81][2];	// [from][to][promote]
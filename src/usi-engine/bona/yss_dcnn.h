@@ -4,6 +4,8 @@
 #ifndef INCLUDE_YSS_DCNN_H_GUARD	//[
 #define INCLUDE_YSS_DCNN_H_GUARD
 
+#include <chrono>
+#include <cstdint>
 #include "lock.h"
 
 const int B_SIZE = 9;
@@ -32,12 +34,61 @@ typedef struct hash_shogi {
 	int col;		// color 1 or 2
 	int age;		//
 	float net_value;		// winrate from value network
+	int net_small;			// evaluated by the small network
 //	int   has_net_value;
 
 	int child_num;
 	CHILD child[SHOGI_MOVES_MAX];
 } HASH_SHOGI;
 
+// search counters and timers. sent per move by info string, and in total at quit.
+enum SEARCH_PHASE {
+	PHASE_MOVEGEN,		// generate_all_move()
+	PHASE_FEATURE,		// set_dcnn_channels()
+	PHASE_FORWARD,		// NN forward
+	PHASE_POLICY,		// mapping policy to legal moves and softmax
+	PHASE_SELECT,		// PUCT selection
+	PHASE_BACKUP,		// winrate update
+	PHASE_HASH,			// HashShogiReadLock()
+	PHASE_LOCK,			// waiting for contended locks
+	PHASE_MAX
+};
+
+typedef struct search_stat {
+	uint64 count;
+	uint64 nsec;
+} SEARCH_STAT;
+
+extern SEARCH_STAT search_stat[PHASE_MAX];
+
+class PhaseTimer {
+public:
+	explicit PhaseTimer(int phase) : phase_(phase), start_(std::chrono::steady_clock::now()) {}
+	~PhaseTimer() { stop(); }
+	void stop() {
+		if ( phase_ < 0 ) return;
+		auto d = std::chrono::steady_clock::now() - start_;
+		search_stat[phase_].count++;
+		search_stat[phase_].nsec += std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+		phase_ = -1;
+	}
+private:
+	int phase_;
+	std::chrono::steady_clock::time_point start_;
+};
+
+// Lock() that measures the wait only when the lock is contended.
+inline void LockStat(lock_yss_t &v)
+{
+#ifdef __ANDROID__
+	if ( pthread_mutex_trylock(&v) == 0 ) return;
+#else
+	if ( *v == 0 ) { Lock(v); return; }
+#endif
+	PhaseTimer t(PHASE_LOCK);
+	Lock(v);
+}
+
 enum {
   WHITE, BLACK, NO_COLOR	// WHITE is Sente(man) turn, BLACK is Gote(com) turn
 };
@@ -48,9 +99,22 @@ extern int fUSIMoveCount;
 extern int fPrtNetworkRawPath;
 
 extern std::string default_weights;
+extern std::string default_weights_small;
+extern std::string default_weights_int8;
+extern int default_int8_calibrate;
+extern std::string default_cpu_precision;
+extern std::string default_weight_cache;
+extern uint64_t default_weights_crc64;
+extern int default_cpu_threads;
+extern int default_cpu_affinity;
+extern std::string default_cpu_isa;
+extern int default_cpu_only;
 #ifdef USE_OPENCL
 extern std::vector<int> default_gpus;
 #endif
+extern int default_batch_size;
+extern int default_batch_ms;
+extern int default_spec;
 
 extern int usi_go_count;
 extern int usi_bestmove_count;
@@ -62,7 +126,9 @@ void debug_print(const char *fmt, ... );
 void PRT(const char *fmt, ...);
 int get_clock();
 double get_spend_time(int ct1);
-void create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg);
+int generate_all_move(tree_t * restrict ptree, int turn, int ply);
+void create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg, int fSmallNet = 0);
+void reevaluate_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg);
 double uct_tree(tree_t * restrict ptree, int sideToMove, int ply);
 int uct_search_start(tree_t * restrict ptree, int sideToMove, int ply, char *buf_move_count);
 void print_all_min_posi(tree_t * restrict ptree, int ply);
@@ -73,6 +139,9 @@ void set_latest_bestmove(char *str);
 int is_send_usi_info(int nodes);
 void send_usi_info(tree_t * restrict ptree, int sideToMove, int ply, int nodes, int nps);
 void usi_newgame();
+void send_search_stat(const SEARCH_STAT *stat, const char *title);
+void send_search_stat_total();
+uint64 get_marge_hash(tree_t * restrict ptree, int sideToMove);
 
 // yss_net.cpp
 void init_network();
@@ -94,7 +163,14 @@ inline void unpack_te(int *bz,int *az,int *tk,int *nf, int te) {
 	*nf = (te      ) & 0xff;
 }
 int get_yss_packmove_from_bona_move(int move);
-float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg);
+float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg, int fSmallNet = 0);
+int is_small_net_ready();
+void spec_network_clear();
+void spec_network_add(tree_t * restrict ptree, int sideToMove, int ply);
+void spec_network_eval();
+int get_network_spec_slots();
+std::string get_network_batch_stats();
+extern uint64 nn_eval_count;
 void add_dirichlet_noise(float epsilon, float alpha, HASH_SHOGI *phg);
 
 #endif	//]] INCLUDE__GUARD
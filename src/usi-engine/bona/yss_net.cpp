@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <algorithm>
+#include <chrono>
 #include <boost/format.hpp>
 #include <boost/program_options.hpp>
 #include <cstdio>
@@ -33,6 +34,7 @@
 #include "../Network.h"
 #include "../GTP.h"
 #include "../Random.h"
+#include "../Utils.h"
 
 
 #include "shogi.h"
@@ -43,7 +45,20 @@
 
 //using namespace Utils;
 std::string default_weights;
+std::string default_weights_small;
+std::string default_weights_int8;
+int default_int8_calibrate = 0;
+std::string default_cpu_precision;
+std::string default_weight_cache;
+uint64_t default_weights_crc64 = 0;
+int default_cpu_threads  = 1;
+int default_cpu_affinity = -1;
+std::string default_cpu_isa;
+int default_cpu_only = 0;
 std::vector<int> default_gpus;
+int default_batch_size = 0;
+int default_batch_ms = 0;
+int default_spec = -1;	// 投機的な batch の穴埋め。-1 で batch をまとめる pipe(OpenCL)の時だけ
 void init_global_objects();	// Leela.cpp
 
 void init_network()
@@ -55,6 +70,22 @@ void init_network()
 //	cfg_weightsfile = "networks/20180620_i362_64x29_iter_1_version.txt";
 //	cfg_weightsfile = "/home/yss/aobazero/networks/20190306_64L29_policy_160_139_bn_relu_cut_visit_x4_iter_910000.txt";
 	if ( !default_weights.empty() ) cfg_weightsfile = default_weights;
+	if ( !default_weights_small.empty() ) cfg_weightsfile_small = default_weights_small;
+	cfg_weightsfile_int8 = default_weights_int8;
+	cfg_int8_calibrate   = (default_int8_calibrate != 0);
+	if ( default_cpu_precision == "fp16" ) cfg_cpu_precision = cpu_precision_t::HALF;
+	if ( default_cpu_precision == "bf16" ) cfg_cpu_precision = cpu_precision_t::BFLOAT16;
+	cfg_weight_cache = default_weight_cache;
+	cfg_weights_crc64 = default_weights_crc64;
+	cfg_cpu_threads  = default_cpu_threads;
+	cfg_cpu_affinity = default_cpu_affinity;
+	cfg_cpu_isa      = default_cpu_isa;
+	if ( default_cpu_only ) cfg_cpu_only = true;
+	cfg_batch_ms = default_batch_ms;
+	if ( default_batch_size > 1 ) {
+		cfg_batch_size  = default_batch_size;
+		cfg_num_threads = default_batch_size;	// forward()を同時に呼んでbatchを埋める
+	}
 
 #ifdef USE_OPENCL
 	if ( !default_gpus.empty() ) {
@@ -101,6 +132,7 @@ int get_motigoma(int m, int hand)
 
 void set_dcnn_channels(tree_t * restrict ptree, int sideToMove, int ply, float *p_data)
 {
+	PhaseTimer t_feature(PHASE_FEATURE);
 	float (*data)[B_SIZE][B_SIZE] = (float(*)[B_SIZE][B_SIZE])p_data;
 	int base = 0;
 	int add_base = 0;
@@ -264,78 +296,88 @@ bool is_nan_inf(float x)
 	return ( std::isnan(x) || std::isinf(x) );
 }
 
-float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg)
+// 投機的にまとめて評価した局面。create_node() で使われるまで保持
+struct SPEC_RESULT {
+	uint64 hashcode64;
+	uint64 hash64pos;
+	std::vector<float> data;
+	Network::Netresult_head result;
+};
+std::vector<SPEC_RESULT> spec_results;
+uint64 nn_eval_count = 0;	// NN で評価した局面数
+
+void spec_network_clear()
 {
-	if ( ptree->nrep < 0 || ptree->nrep >= REP_HIST_LEN ) { PRT("nrep Err=%d\n",ptree->nrep); debug(); }
-
-	int size = 1*DCNN_CHANNELS*B_SIZE*B_SIZE;
-	float *data = new float[size];
-	memset(data, 0, sizeof(float)*size);
-
-	set_dcnn_channels(ptree, sideToMove, ply, data);
-//	if ( 1 || ply==1 ) { prt_dcnn_data_table((float(*)[B_SIZE][B_SIZE])data);  }
-//	{ int sum=0; int i; for (i=0;i<size;i++) sum = 37*sum + (int)(data[i]+0.1); PRT("sum=%d\n",sum); }
-
-//	const auto result = Network::get_scored_moves_yss_zero((float(*)[B_SIZE][B_SIZE])data);
-	const auto result = GTP::s_network->get_scored_moves_yss_zero((float(*)[B_SIZE][B_SIZE])data);
+	spec_results.clear();
+}
 
+void spec_network_add(tree_t * restrict ptree, int sideToMove, int ply)
+{
+	if ( ptree->nrep < 0 || ptree->nrep >= REP_HIST_LEN ) { PRT("nrep Err=%d\n",ptree->nrep); debug(); }
+	SPEC_RESULT sr;
+	sr.hashcode64 = ptree->sequence_hash;
+	sr.hash64pos  = get_marge_hash(ptree, sideToMove);
+	sr.data.resize(DCNN_CHANNELS*B_SIZE*B_SIZE);
+	set_dcnn_channels(ptree, sideToMove, ply, sr.data.data());
+	spec_results.push_back(std::move(sr));
+}
 
-//	float xxx = NAN;
-//	if ( std::isnan(xxx) || std::isinf(xxx) ) PRT("xxx is nan!\n"); else PRT("xxx is not nan...\n");
-    float raw_v = result.second;
-	if ( is_nan_inf(raw_v) ) raw_v = 0;
-	float v_fix = raw_v;	// (raw_v + 1) / 2;
-	if ( sideToMove==BLACK ) v_fix = -v_fix;	// 手番関係なく先手勝ちが+1
-//	float v = (net_eval + 1.0f) / 2.0;	// 0 <= v <= 1
-//    if ( sideToMove ) {	// DCNNは自分が勝ちなら+1、負けなら-1を返す。探索中は先手は+1～0, 後手は 0～-1を返す。
-//        v = v - 1;
-//    }
-//	float v = f_rnd();
-//	if ( sideToMove==BLACK ) v = -v;
-//	phg->net_value      = v_fix;
+// 各局面を別スレッドからforward()して、OpenCLScheduler で1つのbatchにまとめる
+void spec_network_eval()
+{
+	PhaseTimer t(PHASE_FORWARD);
+	nn_eval_count += spec_results.size();
+	std::vector<float*> data;
+	for (auto &sr : spec_results) data.push_back(sr.data.data());
+	auto results = GTP::s_network->get_scored_moves_yss_zero_batch(data);
+	for (size_t i = 0; i < spec_results.size(); i++) spec_results[i].result = std::move(results[i]);
+}
 
-//  std::vector<Network::scored_node> nodelist;
+// 投機的に評価できる局面数。batch の目標サイズ(-batch_ms があれば pipe が調整する)のうち、
+// 選んだ手と pipe で待っている局面で埋まらない分。batch をまとめない pipe(CPU)では
+// batch が大きいほど遅くなるので、-spec 1 を指定しない限り 0
+int get_network_spec_slots()
+{
+	if ( GTP::s_network == nullptr || default_spec == 0 ) return 0;
+	if ( default_spec < 0 && !GTP::s_network->forms_batches() ) return 0;
+	return (int)GTP::s_network->get_idle_batch_slots();
+}
 
-//	PRT("result.first.size()=%d\n",result.first.size());
-	auto &node = result.first;
-//	PRT("node.size()=%d\n",node.size());
-//	{ int i; for (i=0;i<60;i++) PRT("%f,%d\n",node[i].first,node[i].second); }
+// batch size と latency の分布
+std::string get_network_batch_stats()
+{
+	if ( GTP::s_network == nullptr ) return std::string();
+	return GTP::s_network->get_batch_stats();
+}
 
-    float all_sum = 0.0f;
-    for (const auto& node : result.first) {
-        auto id = node.second;
-        all_sum += node.first;
-		int yss_m = get_move_from_c_y_x_id(id);
-		int bz,az,tk,nf;
-		unpack_te(&bz,&az,&tk,&nf, yss_m);
-		int bz_x = bz & 0x0f;
-		int bz_y =(bz & 0xf0) >> 4;
-		int az_x = az & 0x0f;
-		int az_y =(az & 0xf0) >> 4;
-		int from = 0,to = 0;
-		if ( bz==0xff ) {
-			from = tk + 81 - 1;
-		} else {
-			from = (bz_y-1) * 9 + (bz_x-1);
-		}
-		to = (az_y-1) * 9 + (az_x-1);
-		int promotion = nf >> 3;
-		int bona_m = (promotion << 14) | (from <<7) | to;
-		if ( yss_m == 0 ) bona_m = 0;
-		// "piece to move" は moveのみ。dropでは 0
-		
-	    if ( 0 && ply==1 && id < 100 ) PRT("%4d,%08x(%08x),%f\n",id,yss_m,bona_m, node.first);
+static bool find_spec_result(tree_t * restrict ptree, int sideToMove, Network::Netresult_head &result)
+{
+	if ( spec_results.empty() ) return false;
+	uint64 hashcode64 = ptree->sequence_hash;
+	uint64 hash64pos  = get_marge_hash(ptree, sideToMove);
+	for (auto it = spec_results.begin(); it != spec_results.end(); ++it) {
+		if ( it->hashcode64 != hashcode64 || it->hash64pos != hash64pos || it->result.first.empty() ) continue;
+		result = std::move(it->result);
+		spec_results.erase(it);
+		return true;
 	}
+	return false;
+}
 
+int is_small_net_ready()
+{
+	return GTP::s_network_small != nullptr;
+}
 
-	float legal_sum = 0.0f;
-
+// 各合法手の policy の出力 id
+static void get_policy_ids(int sideToMove, HASH_SHOGI *phg, std::vector<int> &ids)
+{
 	int move_num = phg->child_num;
-	unsigned int * restrict pmove = ptree->move_last[0];
+	ids.resize(move_num);
 	int i;
 	for ( i = 0; i < move_num; i++ ) {
-		int move = pmove[i];
 		CHILD *pc = &phg->child[i];
+		int move = pc->move;	// 再評価では生成順に並んでいない
 
 		int from = (int)I2From(move);
 		int to   = (int)I2To(move);
@@ -357,17 +399,73 @@ float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply,
 		}
 		int yss_m = pack_te(bz,az,tk,nf);
 		int id = get_id_from_move(yss_m);
+		if ( id < 0 || id >= Network::POLICY_OUT_NUM ) { PRT("id=%d err\n",id); debug(); }
+		ids[i] = id;
+	}
+}
+
+float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg, int fSmallNet)
+{
+	if ( ptree->nrep < 0 || ptree->nrep >= REP_HIST_LEN ) { PRT("nrep Err=%d\n",ptree->nrep); debug(); }
+
+	// スレッドごとの作業領域。入力はここに直接書き込み、毎回の確保をしない
+	Network::Workspace &ws = Network::get_workspace();
+	int size = 1*DCNN_CHANNELS*B_SIZE*B_SIZE;
+	float *data = ws.input.data();
+	memset(data, 0, sizeof(float)*size);
+
+	Network::Netresult_head &result = ws.result;
+	Network *net = GTP::s_network.get();
+	if ( fSmallNet && GTP::s_network_small ) {
+		net = GTP::s_network_small.get();
+		set_dcnn_channels(ptree, sideToMove, ply, data);
+		PhaseTimer t(PHASE_FORWARD);
+		nn_eval_count++;
+		net->get_scored_moves_yss_zero(ws);
+	} else if ( find_spec_result(ptree, sideToMove, result) == false ) {
+		set_dcnn_channels(ptree, sideToMove, ply, data);
+//		if ( 1 || ply==1 ) { prt_dcnn_data_table((float(*)[B_SIZE][B_SIZE])data);  }
+//		{ int sum=0; int i; for (i=0;i<size;i++) sum = 37*sum + (int)(data[i]+0.1); PRT("sum=%d\n",sum); }
+
+//		result = Network::get_scored_moves_yss_zero((float(*)[B_SIZE][B_SIZE])data);
+		PhaseTimer t(PHASE_FORWARD);
+		nn_eval_count++;
+		net->get_scored_moves_yss_zero(ws);
+	}
+	PhaseTimer t_policy(PHASE_POLICY);
 
-		// node[i].second ... id
-		float bias = node[id].first;
-		if ( id != node[id].second ) { PRT("id=%d,%d err\n",id,node[id].second); debug(); }
-//		if ( ply==1 ) PRT("%3d:%s(%d)(%08x)id=%5d, bias=%8f,from=%2d,to=%2d,cap=%2d,drop=%3d,pr=%d,peice=%d\n",i,str_CSA_move(move),sideToMove,yss_m,id,bias, from,to,cap,drop,is_promote,piece_m);
 
+//	float xxx = NAN;
+//	if ( std::isnan(xxx) || std::isinf(xxx) ) PRT("xxx is nan!\n"); else PRT("xxx is not nan...\n");
+    float raw_v = result.second;
+	if ( is_nan_inf(raw_v) ) raw_v = 0;
+	float v_fix = raw_v;	// (raw_v + 1) / 2;
+	if ( sideToMove==BLACK ) v_fix = -v_fix;	// 手番関係なく先手勝ちが+1
+//	float v = (net_eval + 1.0f) / 2.0;	// 0 <= v <= 1
+//    if ( sideToMove ) {	// DCNNは自分が勝ちなら+1、負けなら-1を返す。探索中は先手は+1～0, 後手は 0～-1を返す。
+//        v = v - 1;
+//    }
+//	float v = f_rnd();
+//	if ( sideToMove==BLACK ) v = -v;
+//	phg->net_value      = v_fix;
+
+//  std::vector<Network::scored_node> nodelist;
+
+	// 合法手の id だけ policy を計算し、合法手の中で softmax
+	int move_num = phg->child_num;
+	std::vector<int> &ids = ws.ids;
+	get_policy_ids(sideToMove, phg, ids);
+	int i;
+
+	std::vector<float> &policy = ws.legal;
+	net->get_legal_policy(result.first, ids, policy);
+	for ( i = 0; i < move_num; i++ ) {
+		CHILD *pc = &phg->child[i];
+		float bias = policy[i];
+//		if ( ply==1 ) PRT("%3d:%s(%d)id=%5d, bias=%8f\n",i,str_CSA_move(pc->move),sideToMove,ids[i],bias);
 		if ( is_nan_inf(bias) ) bias = 0;
 		pc->bias = bias;
-		legal_sum += bias;
 	}
-//	PRT("legal_sum=%9f,all_sum=%f, raw_v=%10f,v_fix=%10f\n",legal_sum,all_sum, raw_v,v_fix );
 
 	if ( fPrtNetworkRawPath ) {
 		PRT("%9.6f(%9.6f)",v_fix,raw_v);
@@ -392,15 +490,9 @@ float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply,
 		phg->child[max_i] = c_tmp;
 	}
 
-	float mul = 1.0f;
-//	PRT("all_sum=%f,legal=%f\n",all_sum,legal_sum);
-	if ( all_sum > legal_sum && legal_sum > 0 ) mul = 1.0f / legal_sum;
-	for ( i = 0; i < phg->child_num; i++ ) {
+	if ( 0 && ply==1 ) for ( i = 0; i < phg->child_num && i < 30; i++ ) {
 		CHILD *pc = &phg->child[i];
-		if ( 0 && ply==1 && i < 30 ) {
-			PRT("%3d:%s(%08x), bias=%8f->(%8f)\n",i,str_CSA_move(pc->move), get_yss_packmove_from_bona_move(pc->move), pc->bias, pc->bias*mul);
-		}
-		pc->bias *= mul;
+		PRT("%3d:%s(%08x), bias=%8f\n",i,str_CSA_move(pc->move), get_yss_packmove_from_bona_move(pc->move), pc->bias);
 	}
 
 
@@ -417,10 +509,145 @@ float get_network_policy_value(tree_t * restrict ptree, int sideToMove, int ply,
 */
 //	if ( ply==1 ) DEBUG_PRT("stop\n");
 
-	delete[] data;
 	return v_fix;
 }
 
+// calib, nndump. 棋譜の各局面をNNで評価する
+int is_int8_calibrating()
+{
+	return cfg_int8_calibrate && !cfg_weightsfile_int8.empty();
+}
+
+static int nn_records_count = 0;
+
+// nnbench. 棋譜の局面の入力を保存しておき、batch size 1..N で評価して速度を測る
+struct NN_BENCH_POS {
+	std::string path;
+	int turn;
+	std::vector<float> data;
+	std::vector<int> ids;	// 合法手の policy の id
+	std::vector<std::string> moves;	// 合法手 USI
+};
+static std::vector<NN_BENCH_POS> nn_bench_corpus;
+const int NN_BENCH_MIN_BATCHES = 32;	// batch size ごとの最小の計測回数
+
+static void nn_bench_add(tree_t * restrict ptree, const char *str_path, HASH_SHOGI *phg)
+{
+	NN_BENCH_POS pos;
+	pos.path = str_path;
+	pos.turn = root_turn;
+	pos.data.resize(DCNN_CHANNELS*B_SIZE*B_SIZE);
+	set_dcnn_channels(ptree, root_turn, 1, pos.data.data());
+
+	static HASH_SHOGI hg_usi;	// USI に変換できる手だけ
+	hg_usi.child_num = 0;
+	for (int i = 0; i < phg->child_num; i++) {
+		char str_usi[8];
+		if ( csa2usi( ptree, str_CSA_move(phg->child[i].move), str_usi ) < 0 ) continue;
+		hg_usi.child[hg_usi.child_num++] = phg->child[i];
+		pos.moves.push_back(str_usi);
+	}
+	get_policy_ids(root_turn, &hg_usi, pos.ids);
+	nn_bench_corpus.push_back(std::move(pos));
+}
+
+static double nn_bench_percentile(const std::vector<double> &sorted, double pct)
+{
+	size_t i = (size_t)(pct / 100.0 * (sorted.size() - 1) + 0.5);
+	return sorted[i];
+}
+
+// batch size ごとに1行の JSON を出し、最大の batch size の結果を net-test の形式で書き出す
+static void nn_bench_run(FILE *pf)
+{
+	int n = (int)nn_bench_corpus.size();
+	if ( n == 0 ) return;
+	int max_batch = cfg_batch_size > 0 ? cfg_batch_size : 1;
+	Network *net = GTP::s_network.get();
+	std::vector<Network::Netresult_head> results(n);
+	std::vector<float*> data;
+
+	for (int b = 1; b <= max_batch; b++) {
+		int batches = std::max((n + b - 1) / b, NN_BENCH_MIN_BATCHES);
+		std::vector<double> ms;
+		double sec_sum = 0;
+		for (int k = -1; k < batches; k++) {	// k == -1 は計測しない
+			int first = std::max(k, 0) * b;
+			data.clear();
+			for (int j = 0; j < b; j++) data.push_back(nn_bench_corpus[(first + j) % n].data.data());
+			auto t0 = std::chrono::steady_clock::now();
+			auto r = net->get_scored_moves_yss_zero_batch(data);
+			double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+			if ( k < 0 ) continue;
+			sec_sum += sec;
+			ms.push_back(sec * 1000.0);
+			if ( b != max_batch ) continue;
+			for (int j = 0; j < b && first + j < n; j++) results[first + j] = std::move(r[j]);
+		}
+		std::sort(ms.begin(), ms.end());
+		USIOut( "{\"batch_size\":%d,\"batches\":%d,\"positions_per_sec\":%.1f,"
+			"\"latency_ms\":{\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"max\":%.3f}}\n",
+			b, batches, batches * b / sec_sum,
+			nn_bench_percentile(ms, 50), nn_bench_percentile(ms, 90),
+			nn_bench_percentile(ms, 99), ms.back() );
+	}
+
+	std::vector<float> policy;
+	for (int i = 0; i < n; i++) {
+		NN_BENCH_POS &pos = nn_bench_corpus[i];
+		float v = results[i].second;
+		if ( is_nan_inf(v) ) v = 0;
+		if ( pos.turn==BLACK ) v = -v;
+		net->get_legal_policy(results[i].first, pos.ids, policy);
+		fprintf(pf, "position startpos moves%s\ninput\nvalue %.6f\npolicy", pos.path.c_str(), v);
+		for (size_t j = 0; j < pos.moves.size(); j++) {
+			float bias = policy[j];
+			if ( is_nan_inf(bias) ) bias = 0;
+			fprintf(pf, " %s %.6f", pos.moves[j].c_str(), bias);
+		}
+		fprintf(pf, "\nEND\n");
+	}
+	nn_bench_corpus.clear();
+}
+
+// pf が NULL でなければ net-test の形式で value と policy を書き出す
+void nn_records_position(tree_t * restrict ptree, const char *str_path, FILE *pf, int mode)
+{
+	static HASH_SHOGI hg;
+	int move_num = generate_all_move( ptree, root_turn, 1 );
+	unsigned int * restrict pmove = ptree->move_last[0];
+	int i;
+	for ( i = 0; i < move_num; i++ ) {
+		hg.child[i].move = pmove[i];
+		hg.child[i].bias = 0;
+	}
+	hg.child_num = move_num;
+	nn_records_count++;
+	if ( mode == nn_records_bench ) {
+		nn_bench_add(ptree, str_path, &hg);
+		return;
+	}
+	float v = get_network_policy_value(ptree, root_turn, 1, &hg);
+	if ( pf == NULL ) return;
+
+	fprintf(pf, "position startpos moves%s\ninput\nvalue %.6f\npolicy", str_path, v);
+	for ( i = 0; i < hg.child_num; i++ ) {
+		char str_usi[8];
+		if ( csa2usi( ptree, str_CSA_move(hg.child[i].move), str_usi ) < 0 ) continue;
+		fprintf(pf, " %s %.6f", str_usi, hg.child[i].bias);
+	}
+	fprintf(pf, "\nEND\n");
+}
+
+int nn_records_end(int mode, FILE *pf)
+{
+	PRT("%d positions\n", nn_records_count);
+	nn_records_count = 0;
+	if ( mode == nn_records_bench ) nn_bench_run(pf);
+	if ( mode == nn_records_calib && GTP::s_network->save_int8_calibration() == false ) return -1;
+	return 1;
+}
+
 void get_c_y_x_from_move(int *pc, int *py, int *px, int pack_move)
 {
 	unsigned int n = (unsigned int)pack_move;
@@ -25,6 +25,7 @@
 #include "yss_dcnn.h"
 
 #include "../GTP.h"
+#include "../Trace.h"
 
 int NOT_USE_NN = 0;
 
@@ -40,7 +41,22 @@ int fClearHashAlways = 0;
 int fUsiInfo = 0;
 
 int UCT_LOOP_FIX = 100;
+int nPlayoutCapFast = 0;		// playout cap randomization. 0 で無効。full search 以外の手はこの回数だけ探索
+int nPlayoutCapFullPct = 25;	// full search する手の割合(%)
+int nResignWinratePct = 0;		// 勝率(%)がこれ未満なら投了。0 で投了しない
+int nResignMoves = 3;			// この手数連続で下回ったら投了
+int nNoResignPct = 10;			// 投了しない対局の割合(%)。誤投了率の測定用
 int reached_ply = 0;
+int spec_count = 0;	// 投機的に展開したノード数
+int fSpecBestLine = 0;	// uct_tree() が root から最善手(最多訪問)だけを辿っている
+int nSmallNetPly = 6;		// この深さより深い展開は小さいネットワーク(-w2)で評価
+int nSmallNetVisit = 0;		// 親の訪問回数がこれ未満の展開も小さいネットワークで評価
+int nSmallNetReeval = 8;	// 小さいネットワークのノードがこの回数訪問されたら大きいネットワークで再評価
+int small_count = 0;
+int reeval_count = 0;
+int search_playouts = 0;	// 直前の uct_search_start() の playout 数
+int fBenchRunning = 0;		// bench 中は入力で探索を止めない
+SEARCH_STAT search_stat[PHASE_MAX];
 
 HASH_SHOGI *hash_shogi_table = NULL;
 const int HASH_SHOGI_TABLE_SIZE_MIN = 1024*4*4;
@@ -202,6 +218,7 @@ void print_path() {}
 
 int generate_all_move(tree_t * restrict ptree, int turn, int ply)
 {
+	PhaseTimer t(PHASE_MOVEGEN);
 	unsigned int * restrict pmove = ptree->move_last[0];
 	ptree->move_last[1] = GenCaptures( turn, pmove );
 	ptree->move_last[1] = GenNoCaptures( turn, ptree->move_last[1] );
@@ -338,7 +355,7 @@ int YssZero_com_turn_start( tree_t * restrict ptree )
 		csa2usi( ptree, str_CSA_move(m), buf );
 	}
 	char str_best[USI_BESTMOVE_LEN];
-	if ( fUSIMoveCount ) {
+	if ( fUSIMoveCount && m ) {
 		sprintf( str_best,"bestmove %s,%s\n",buf,buf_move_count );
 	} else {
 		sprintf( str_best,"bestmove %s\n",   buf );
@@ -507,6 +524,7 @@ void free_hash_shogi_table()
 
 HASH_SHOGI* HashShogiReadLock(tree_t * restrict ptree, int sideToMove)
 {
+	PhaseTimer t(PHASE_HASH);
 research_empty_block:
 	int n,first_n,loop = 0;
 
@@ -523,7 +541,7 @@ research_empty_block:
 
 	for (;;) {
 		HASH_SHOGI *pt = &pt_base[n];
-		Lock(pt->entry_lock);		// Lockをかけっぱなしにするように
+		LockStat(pt->entry_lock);		// Lockをかけっぱなしにするように
 		if ( pt->deleted == 0 ) {
 			if ( hashcode64 == pt->hashcode64 && hash64pos == pt->hash64pos ) {
 				return pt;
@@ -541,7 +559,7 @@ research_empty_block:
 //	{ static int count, loop_sum; count++; loop_sum+=loop; PRT("%d,",loop); if ( (count%100)==0 ) PRT("loop_ave=%.1f\n",(float)loop_sum/count); }
 	if ( pt_first ) {
 		// 検索中に既にpt_firstが使われてしまっていることもありうる。もしくは同時に同じ場所を選んでしまうケースも。
-		Lock(pt_first->entry_lock);
+		LockStat(pt_first->entry_lock);
 		if ( pt_first->deleted == 0 ) {	// 先に使われてしまった！
 			UnLock(pt_first->entry_lock);
 			goto research_empty_block;
@@ -598,6 +616,37 @@ char *prt_pv_from_hash(tree_t * restrict ptree, int ply, int sideToMove, int fus
 	return str;
 }
 
+int fNoResignGame = 0;
+int resign_count[2];
+int resign_last_nrep = INT_MAX;
+
+// 開始局面に戻ったら新しい対局とみなす
+void init_resign_game()
+{
+	fNoResignGame = ( f_rnd() * 100.0f < nNoResignPct );
+	resign_count[0] = resign_count[1] = 0;
+	PRT("new game. fNoResignGame=%d\n",fNoResignGame);
+}
+
+int is_resign(int sideToMove, int nrep, double winrate)
+{
+	if ( nResignWinratePct <= 0 ) return 0;
+	if ( nrep < resign_last_nrep ) init_resign_game();
+	resign_last_nrep = nrep;
+
+	if ( winrate * 100.0 >= nResignWinratePct ) {
+		resign_count[sideToMove] = 0;
+		return 0;
+	}
+	if ( ++resign_count[sideToMove] < nResignMoves ) return 0;
+	if ( fNoResignGame ) {
+		// 投了しない対局では、最初に投了していたはずの手だけ知らせる
+		if ( resign_count[sideToMove] == nResignMoves ) USIOut("info string noresign\n");
+		return 0;
+	}
+	return 1;
+}
+
 int uct_search_start(tree_t * restrict ptree, int sideToMove, int ply, char *buf_move_count)
 {
 	if ( fClearHashAlways ) {
@@ -612,32 +661,50 @@ int uct_search_start(tree_t * restrict ptree, int sideToMove, int ply, char *buf
 		}
 	}
 	
+	SEARCH_STAT stat_start[PHASE_MAX];
+	memcpy(stat_start, search_stat, sizeof(search_stat));
+
 	HASH_SHOGI *phg = HashShogiReadLock(ptree, sideToMove);
 	create_node(ptree, sideToMove, ply, phg);
+	if ( phg->net_small ) reevaluate_node(ptree, sideToMove, ply, phg);	// rootは必ず大きいネットワーク
 	UnLock(phg->entry_lock);
 
+	// playout cap randomization. full search の手だけ policy の学習対象にする
+	int fFullSearch = 1;
+	if ( nPlayoutCapFast > 0 ) {
+		static std::uniform_real_distribution<> dist(0, 1);
+		if ( dist(get_mt_rand) * 100.0 >= nPlayoutCapFullPct ) fFullSearch = 0;
+	}
+
 	const float epsilon = 0.25f;	// epsilon = 0.25
 	const float alpha   = 0.15f;	// alpha ... Chess = 0.3, Shogi = 0.15, Go = 0.03
-	if ( fAddNoise ) add_dirichlet_noise(epsilon, alpha, phg);
+	if ( fAddNoise && fFullSearch ) add_dirichlet_noise(epsilon, alpha, phg);
 //{ void test_dirichlet_noise(float epsilon, float alpha);  test_dirichlet_noise(0.25f, 0.03f); }
 	PRT("root phg->hash=%" PRIx64 ", child_num=%d\n",phg->hashcode64,phg->child_num);
 
 	int ct1 = get_clock();
-	int uct_count = UCT_LOOP_FIX;
+	spec_count = 0;
+	small_count = 0;
+	reeval_count = 0;
+	int uct_count = fFullSearch ? UCT_LOOP_FIX : nPlayoutCapFast;
 	int sum_reached_ply = 0;
 	int loop_count = 0;
 	int loop;
 	for (loop=0; loop<uct_count; loop++) {
+		Trace::Scope trace("uct_tree", "depth");
 		reached_ply = 0;
+		fSpecBestLine = 1;
 		uct_tree(ptree, sideToMove, ply);
+		trace.set_arg(reached_ply);
 		sum_reached_ply += reached_ply;
 		loop_count++;
 //		if ( IsNegaMaxTimeOver() ) break;
 //		if ( is_main_thread() ) PassWindowsSystem();	// GUIスレッド以外に渡すと中断が利かない場合あり
 		if ( is_send_usi_info(loop+1) ) send_usi_info(ptree, sideToMove, ply, loop+1, (int)((loop+1)/get_spend_time(ct1)));
-		if ( check_enter_input() == 1 ) break;
+		if ( fBenchRunning == 0 && check_enter_input() == 1 ) break;
 		if ( IsHashFull() ) break;
 	}
+	search_playouts = loop;
 	if ( loop_count == 0 ) loop_count = 1;
 	double ave_reached_ply = (double)sum_reached_ply / loop_count;
 	double ct = get_spend_time(ct1);
@@ -699,6 +766,7 @@ int uct_search_start(tree_t * restrict ptree, int sideToMove, int ply, char *buf
 	
 	buf_move_count[0] = 0;
 	sprintf(buf_move_count,"%d",sum_games);
+	if ( fFullSearch==0 ) sort_n = 0;	// 候補手なしは value だけの学習対象
 	for (i=0;i<sort_n;i++) {
 		char buf[7];
 		csa2usi( ptree, str_CSA_move(sort[i][1]), buf );
@@ -751,14 +819,45 @@ int uct_search_start(tree_t * restrict ptree, int sideToMove, int ply, char *buf
 		PRT("rand select:%s,%3d,%6.3f,bias=%6.3f,r=%d/%d\n",str_CSA_move(pc->move),pc->games,pc->value,pc->bias,r,sum_games);
 	}
 
-	PRT("%.2f sec, child=%d,net_v=%.3f,create=%d,loop=%d,%.0f/s,ave_ply=%.1f (%d/%d),fAddNoise=%d\n",
-		ct,phg->child_num,phg->net_value,hash_shogi_use,loop,(double)loop/ct,ave_reached_ply,ptree->nrep,nVisitCount,fAddNoise );
+	PRT("%.2f sec, child=%d,net_v=%.3f,create=%d,loop=%d,%.0f/s,ave_ply=%.1f (%d/%d),fAddNoise=%d,full=%d,spec=%d,small=%d,reeval=%d\n",
+		ct,phg->child_num,phg->net_value,hash_shogi_use,loop,(double)loop/ct,ave_reached_ply,ptree->nrep,nVisitCount,fAddNoise,fFullSearch,spec_count,small_count,reeval_count );
+
+	SEARCH_STAT stat_move[PHASE_MAX];
+	for (i=0; i<PHASE_MAX; i++) {
+		stat_move[i].count = search_stat[i].count - stat_start[i].count;
+		stat_move[i].nsec  = search_stat[i].nsec  - stat_start[i].nsec;
+	}
+	send_search_stat(stat_move, "stat");
+
+	if ( max_i >= 0 && is_resign(sideToMove, ptree->nrep, (phg->child[max_i].value + 1.0) / 2.0) ) {
+		PRT("resign. count=%d\n",resign_count[sideToMove]);
+		best_move = 0;
+	}
 
 	return best_move;
 }
 
-void create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg)
+int use_small_net(int ply, int parent_games)
+{
+	if ( is_small_net_ready() == 0 ) return 0;
+	if ( nSmallNetPly > 0 && ply > nSmallNetPly ) return 1;
+	if ( parent_games < nSmallNetVisit ) return 1;
+	return 0;
+}
+
+// 小さいネットワークで作ったノードの policy と value を大きいネットワークで置き換える。探索済みの games, value はそのまま
+void reevaluate_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg)
+{
+	float v = get_network_policy_value(ptree, sideToMove, ply, phg);
+	if ( sideToMove==BLACK ) v = -v;
+	phg->net_value = v;
+	phg->net_small = 0;
+	reeval_count++;
+}
+
+void create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg, int fSmallNet)
 {
+	Trace::Scope trace("create_node", "ply", ply);
 	if ( phg->deleted == 0 ) {
 		PRT("already created? ply=%d,sideToMove=%d,games_sum=%d,child_num=%d\n",ply,sideToMove,phg->games_sum,phg->child_num); print_path();
 		return;
@@ -813,7 +912,8 @@ void create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *p
 //		{ static double va[2]; static int count[2]; va[sideToMove] += v; count[sideToMove]++; PRT("va[]=%10f,%10f\n",va[0]/(count[0]+1),va[1]/(count[1]+1)); }
 //		PRT("f=%10f,tanh()=%10f\n",f,v);
 	} else {
-		v = get_network_policy_value(ptree, sideToMove, ply, phg);
+		v = get_network_policy_value(ptree, sideToMove, ply, phg, fSmallNet);
+		if ( fSmallNet ) small_count++;
 	}
 	if ( sideToMove==BLACK ) v = -v;
 
@@ -823,12 +923,76 @@ void create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *p
 	phg->col            = sideToMove;
 	phg->age            = thinking_age;
 	phg->net_value      = v;
+	phg->net_small      = fSmallNet;
 	phg->deleted        = 0;
 
 //	PRT("create_node(),"); prt64(phg->hashcode64); PRT("\n"); print_path(); 
 	hash_shogi_use++;
 }
 
+// 選んだ手を評価する際に、まだ展開していない兄弟局面を bias の高い順に加えて batch を埋める。
+// 結果はハッシュ表のノードとして登録され、その手が選ばれた時にそのまま使われる。
+void speculative_create_node(tree_t * restrict ptree, int sideToMove, int ply, HASH_SHOGI *phg, int select, int spec_slots)
+{
+	int cand_i[MAX_LEGAL_MOVES];
+	int cand[MAX_LEGAL_MOVES+1];
+	int cand_n = 0;
+	int i,j;
+	for (i=0; i<phg->child_num; i++) {
+		CHILD *pc = &phg->child[i];
+		if ( i==select || pc->games || pc->value == ILLEGAL_MOVE ) continue;
+		for (j=cand_n; j>0 && phg->child[cand_i[j-1]].bias < pc->bias; j--) cand_i[j] = cand_i[j-1];
+		cand_i[j] = i;
+		cand_n++;
+	}
+	// 選んだ手を先頭に、残りは bias の高い順
+	int select_move = phg->child[select].move;
+	cand[0] = select_move;
+	for (i=0; i<cand_n; i++) cand[i+1] = phg->child[cand_i[i]].move;
+	cand_n++;
+	UnLock(phg->entry_lock);
+
+	int spec_move[MAX_LEGAL_MOVES];
+	int spec_n = 0;
+	spec_network_clear();
+	int spec_max = 1 + spec_slots;	// 選んだ手 + batch の空き
+	for (i=0; i<cand_n && spec_n < spec_max; i++) {
+		int move = cand[i];
+		MakeMove( sideToMove, move, ply );
+		if ( InCheck(sideToMove) == 0 ) {
+			MOVE_CURR = move;
+			copy_min_posi(ptree, Flip(sideToMove), ply);
+			HASH_SHOGI *phg2 = HashShogiReadLock(ptree, Flip(sideToMove));
+			int deleted = phg2->deleted;
+			UnLock(phg2->entry_lock);
+			if ( deleted ) {
+				spec_network_add(ptree, Flip(sideToMove), ply+1);
+				spec_move[spec_n++] = move;
+			}
+		}
+		UnMakeMove( sideToMove, move, ply );
+	}
+
+	if ( spec_n > 1 ) {
+		spec_network_eval();
+		spec_count += spec_n - 1;
+		for (i=0; i<spec_n; i++) {
+			int move = spec_move[i];
+			if ( move == select_move ) continue;	// 選んだ手は uct_tree() で展開
+			MakeMove( sideToMove, move, ply );
+			MOVE_CURR = move;
+			copy_min_posi(ptree, Flip(sideToMove), ply);
+			HASH_SHOGI *phg2 = HashShogiReadLock(ptree, Flip(sideToMove));
+			if ( phg2->deleted ) create_node(ptree, Flip(sideToMove), ply+1, phg2);
+			UnLock(phg2->entry_lock);
+			UnMakeMove( sideToMove, move, ply );
+		}
+	} else {
+		spec_network_clear();
+	}
+	LockStat(phg->entry_lock);
+}
+
 double uct_tree(tree_t * restrict ptree, int sideToMove, int ply)
 {
 	int create_new_node_limit = 1;
@@ -842,18 +1006,27 @@ double uct_tree(tree_t * restrict ptree, int sideToMove, int ply)
 		create_node(ptree, sideToMove, ply, phg);
 	}
 
+	if ( phg->net_small && phg->games_sum >= nSmallNetReeval ) reevaluate_node(ptree, sideToMove, ply, phg);
+
 	if ( phg->col != sideToMove ) { PRT("hash col Err. phg->col=%d,col=%d,age=%d(%d),ply=%d,nrep=%d,child_num=%d,games_sum=%d,sort=%d,phg->hash=%" PRIx64 "\n",phg->col,sideToMove,phg->age,thinking_age,ply,ptree->nrep,phg->child_num,phg->games_sum,phg->sort_done,phg->hashcode64); debug(); }
 
 	int child_num = phg->child_num;
 
 	int select = -1;
+	int best_games = -1;
+	int best = -1;	// 最多訪問の手。同数なら bias の高い手
 	int loop;
 	double max_value = -10000;
 
+	PhaseTimer t_select(PHASE_SELECT);
 select_again:
  	for (loop=0; loop<child_num; loop++) {
 		CHILD *pc  = &phg->child[loop];
 		if ( pc->value == ILLEGAL_MOVE ) continue;
+		if ( pc->games > best_games || (pc->games == best_games && pc->bias > phg->child[best].bias) ) {
+			best_games = pc->games;
+			best = loop;
+		}
 
 		const double cBASE = 19652.0;
 		const double cINIT = 1.25;
@@ -881,6 +1054,7 @@ select_again:
 			select = loop;
 		}
 	}
+	t_select.stop();
 	if ( select < 0 ) {
 		float v = -1;
 		if ( sideToMove==BLACK ) v = -1;
@@ -898,9 +1072,18 @@ select_again:
 		pc->value = ILLEGAL_MOVE;
 		select = -1;
 		max_value = -10000;
+		best_games = -1;
+		best = -1;
 		goto select_again;
 //		debug();
 	}
+	int fSmallNet = use_small_net(ply+1, phg->games_sum);
+	// 投機的な展開は最善手順上の局面で、batch が空く時だけ
+	if ( fSpecBestLine && cfg_batch_size > 1 && pc->games < create_new_node_limit && ply < PLY_MAX-11 && fSmallNet == 0 ) {
+		int spec_slots = get_network_spec_slots();
+		if ( spec_slots > 0 ) speculative_create_node(ptree, sideToMove, ply, phg, select, spec_slots);
+	}
+	if ( select != best ) fSpecBestLine = 0;
 //	PRT("%2d:%s:SHash=%016" PRIx64,ply,str_CSA_move(pc->move),ptree->sequence_hash);
 	MakeMove( sideToMove, pc->move, ply );
 //	PRT(" -> %016" PRIx64 "\n",ptree->sequence_hash);
@@ -1020,14 +1203,14 @@ select_again:
 
 		HASH_SHOGI *phg2 = HashShogiReadLock(ptree, Flip(sideToMove));	// 1手進めた局面のデータ
 		if ( phg2->deleted ) {
-			create_node(ptree, Flip(sideToMove), ply+1, phg2);
+			create_node(ptree, Flip(sideToMove), ply+1, phg2, fSmallNet);
 		} else {
 //			PRT("has come already?\n"); //debug();	// 手順前後?
 		}
 		win = -phg2->net_value;
 		
 		UnLock(phg2->entry_lock);
-		Lock(phg->entry_lock);
+		LockStat(phg->entry_lock);
 
 	} else {
 		// down tree
@@ -1042,7 +1225,7 @@ select_again:
 
 		UnLock(phg->entry_lock);
 		win = -uct_tree(ptree, Flip(sideToMove), ply+1);
-		Lock(phg->entry_lock);
+		LockStat(phg->entry_lock);
 
 		if ( fVirtualLoss ) {
 			phg->games_sum -= VL_N;
@@ -1055,6 +1238,7 @@ select_again:
 
 	UnMakeMove( sideToMove, pc->move, ply );
 
+	PhaseTimer t_backup(PHASE_BACKUP);
 	double win_prob = ((double)pc->games * pc->value + win) / (pc->games + 1);	// 単純平均
 
 	pc->value = (float)win_prob;
@@ -1124,6 +1308,7 @@ void print_all_min_posi(tree_t * restrict ptree, int ply)
 }
 
 std::string keep_cmd_line;
+std::string cmdline_command;	// bench, calib, nndump, nnbench をコマンドラインから実行
 
 int getCmdLineParam(int argc, char *argv[])
 {
@@ -1138,6 +1323,21 @@ int getCmdLineParam(int argc, char *argv[])
 //		PRT("argv[%d]=%s\n",i,sa[0]);
 		char *p = sa[0];
 		char *q = sa[1];
+		if ( strcmp(p,"bench") == 0 ) {	// aobaz -w file bench [positions file]
+			cmdline_command = "bench";
+			if ( i+1 < argc && strncmp(q,"-",1) != 0 ) { cmdline_command += " "; cmdline_command += q; }
+			continue;
+		}
+		// aobaz -w file -q8 int8file calib records.csa ...
+		// aobaz -w file [-q8 int8file] nndump out.txt records.csa ...
+		// aobaz -w file [-q8 int8file] [-cpu] -b N nnbench out.txt records.csa ...
+		if ( strcmp(p,"calib") == 0 || strcmp(p,"nndump") == 0 || strcmp(p,"nnbench") == 0 ) {
+			cmdline_command = p;
+			int j;
+			for (j=i+1; j<argc && strncmp(argv[j],"-",1) != 0; j++) { cmdline_command += " "; cmdline_command += argv[j]; }
+			if ( strcmp(p,"calib") == 0 ) default_int8_calibrate = 1;
+			continue;
+		}
 		if ( strncmp(p,"-",1) != 0 ) continue;
 
 		float nf = (float)atof(q);
@@ -1153,6 +1353,106 @@ int getCmdLineParam(int argc, char *argv[])
 			cfg_random_temp = nf;
 			continue;
 		}
+		if ( strstr(p,"-pcap_n") ) {
+			PRT("playout cap randomization. fast playouts=%d\n",n);
+			nPlayoutCapFast = n;
+			continue;
+		}
+		if ( strstr(p,"-pcap_pct") ) {
+			PRT("playout cap randomization. full search=%d%%\n",n);
+			nPlayoutCapFullPct = n;
+			continue;
+		}
+		if ( strstr(p,"-resign_pct") ) {
+			PRT("resign winrate=%d%%\n",n);
+			nResignWinratePct = n;
+			continue;
+		}
+		if ( strstr(p,"-resign_n") ) {
+			PRT("resign after %d moves\n",n);
+			nResignMoves = n;
+			continue;
+		}
+		if ( strstr(p,"-noresign_pct") ) {
+			PRT("no resign games=%d%%\n",n);
+			nNoResignPct = n;
+			continue;
+		}
+		if ( strstr(p,"-w2_ply") ) {
+			PRT("small network over ply=%d\n",n);
+			nSmallNetPly = n;
+			continue;
+		}
+		if ( strstr(p,"-w2_visit") ) {
+			PRT("small network under parent visits=%d\n",n);
+			nSmallNetVisit = n;
+			continue;
+		}
+		if ( strstr(p,"-w2_reeval") ) {
+			PRT("re-evaluate small network nodes at visits=%d\n",n);
+			nSmallNetReeval = n;
+			continue;
+		}
+		if ( strstr(p,"-w2") ) {
+			PRT("small network path=%s\n",q);
+			default_weights_small = q;
+			continue;
+		}
+		if ( strstr(p,"-wcrc") ) {
+			PRT("weights crc64=%s\n",q);
+			default_weights_crc64 = strtoull(q, NULL, 16);
+			continue;
+		}
+		if ( strstr(p,"-wcache") ) {
+			PRT("weight cache directory=%s\n",q);
+			default_weight_cache = q;
+			continue;
+		}
+		if ( strstr(p,"-q8") ) {
+			PRT("INT8 network path=%s\n",q);
+			default_weights_int8 = q;
+			continue;
+		}
+		if ( strstr(p,"-cpu_prec") ) {
+			PRT("CPU filter precision=%s\n",q);
+			default_cpu_precision = q;
+			continue;
+		}
+		if ( strstr(p,"-cpu_threads") ) {
+			PRT("CPU forward threads=%d\n",n);
+			default_cpu_threads = n;
+			continue;
+		}
+		if ( strstr(p,"-cpu_isa") ) {
+			PRT("CPU kernels up to ISA level %s\n",q);
+			default_cpu_isa = q;
+			continue;
+		}
+		if ( strstr(p,"-cpu_affinity") ) {
+			PRT("CPU forward threads from logical CPU %d\n",n);
+			default_cpu_affinity = n;
+			continue;
+		}
+		if ( strcmp(p,"-cpu") == 0 ) {
+			PRT("CPU evaluation\n");
+			default_cpu_only = 1;
+			continue;
+		}
+		if ( strstr(p,"-spec") ) {
+			PRT("speculative batch filling=%d\n",n);
+			default_spec = n;
+			continue;
+		}
+		if ( strstr(p,"-batch_ms") ) {
+			PRT("batch latency cap=%d ms\n",n);
+			default_batch_ms = n;
+			continue;
+		}
+		if ( strstr(p,"-trace") ) {
+			PRT("trace file=%s\n",q);
+			Trace::open(q);
+			continue;
+		}
 		if ( strstr(p,"-time_sec") ) {
 //			PRT("sec=%d\n",n);
 //			NegaMaxTimeLimit = n;
@@ -1181,6 +1481,10 @@ int getCmdLineParam(int argc, char *argv[])
 //			PRT("mt=%d\n",n);
 //			aya_set_thread(n);
 		}
+		if ( strstr(p,"-b") ) {
+			PRT("batch size=%d\n",n);
+			default_batch_size = n;
+		}
 		if ( strstr(p,"-w") ) {
 			PRT("network path=%s\n",q);
 			default_weights = q;
@@ -1224,6 +1528,12 @@ const char *get_cmd_line_ptr()
 	return keep_cmd_line.c_str();
 }
 
+const char *get_cmdline_command()
+{
+	if ( cmdline_command.empty() ) return NULL;
+	return cmdline_command.c_str();
+}
+
 #if defined(_MSC_VER)
 int check_enter_input()
 {
@@ -1323,11 +1633,136 @@ void send_usi_info(tree_t * restrict ptree, int sideToMove, int ply, int nodes,
 	USIOut( "%s", str);
 }
 
+// 処理ごとの回数と時間(ms)、ハッシュ表の使用数
+void send_search_stat(const SEARCH_STAT *stat, const char *title)
+{
+	static const char *phase_name[PHASE_MAX] = { "movegen", "feature", "forward", "policy", "select", "backup", "hash", "lock" };
+	char str[TMP_BUF_LEN];
+	char buf[TMP_BUF_LEN];
+	sprintf(str,"info string %s",title);
+	for (int i=0; i<PHASE_MAX; i++) {
+		sprintf(buf," %s %llu %.1f",phase_name[i],(unsigned long long)stat[i].count,stat[i].nsec / 1000000.0);
+		strcat(str,buf);
+	}
+	sprintf(buf," node %d/%d\n",hash_shogi_use,Hash_Shogi_Table_Size);
+	strcat(str,buf);
+	PRT("%s",str);
+	USIOut( "%s", str);
+	// batch の統計は起動してからの累計
+	snprintf(str,TMP_BUF_LEN,"info string batch %s\n",get_network_batch_stats().c_str());
+	PRT("%s",str);
+	USIOut( "%s", str);
+}
+
+void send_search_stat_total()
+{
+	send_search_stat(search_stat, "stat_total");
+}
+
 void usi_newgame()
 {
 	hash_shogi_table_clear();
+	resign_last_nrep = INT_MAX;
+}
+
+
+// bench。固定局面を固定の乱数で探索して、速度と指し手の signature を JSON で返す
+const char *bench_positions[] = {
+	"startpos",
+	"startpos moves 7g7f 3c3d 2g2f 8c8d 2f2e 8d8e 6i7h 4a3b 2e2d 2c2d 2h2d P*2c 2d2f",
+	"startpos moves 7g7f 8c8d 7i6h 3c3d 6h7g 7a6b 5g5f 5c5d 3i4h 3a4b 4i5h 4a3b 6i7h 5a4a",
+	"startpos moves 7g7f 3c3d 6g6f 8c8d 2h6h 8d8e 8h7g 7a6b 5i4h 5a4b",
+	"startpos moves 2g2f 8c8d 2f2e 8d8e 7g7f 4a3b 8h7g 3c3d 7i8h 2b7g+ 8h7g 3a2b",
+	NULL
+};
+
+const uint64 BENCH_SEED = 20190501;
+static int bench_ct1;
+static int bench_positions_n;
+static int bench_playouts;
+static double bench_occupancy;
+static uint64 bench_signature;
+static uint64 bench_nn_eval_start;
+static uint64 bench_forward_start;
+static std::string bench_moves;
+static int bench_keep[4];
+
+void bench_start()
+{
+	// 乱数を使う設定は止める
+	bench_keep[0] = fAddNoise;
+	bench_keep[1] = nVisitCount;
+	bench_keep[2] = nPlayoutCapFast;
+	bench_keep[3] = nResignWinratePct;
+	fAddNoise = 0;
+	nVisitCount = 0;
+	nPlayoutCapFast = 0;
+	nResignWinratePct = 0;
+
+	bench_positions_n   = 0;
+	bench_playouts      = 0;
+	bench_occupancy     = 0;
+	bench_signature     = 0xcbf29ce484222325ULL;	// FNV-1a
+	bench_nn_eval_start = nn_eval_count;
+	bench_forward_start = search_stat[PHASE_FORWARD].count;
+	bench_moves.clear();
+	fBenchRunning = 1;
+	bench_ct1 = get_clock();
 }
 
+int bench_search( tree_t * restrict ptree )
+{
+	hash_shogi_table_clear();
+	init_rnd521(BENCH_SEED);
+
+	char buf_move_count[USI_BESTMOVE_LEN];
+	int m = uct_search_start( ptree, root_turn, 1, buf_move_count );
+
+	char buf[7];
+	if ( m == 0 ) {
+		strcpy(buf,"resign");
+	} else {
+		csa2usi( ptree, str_CSA_move(m), buf );
+	}
+	for (const char *s = buf; *s; s++) {
+		bench_signature ^= (unsigned char)*s;
+		bench_signature *= 0x100000001b3ULL;
+	}
+	bench_signature ^= ',';
+	bench_signature *= 0x100000001b3ULL;
+
+	if ( bench_positions_n ) bench_moves += ",";
+	bench_moves += "\"";
+	bench_moves += buf;
+	bench_moves += "\"";
+	bench_positions_n++;
+	bench_playouts  += search_playouts;
+	bench_occupancy += (double)hash_shogi_use / Hash_Shogi_Table_Size;
+	return m;
+}
+
+void bench_end()
+{
+	double sec = get_spend_time(bench_ct1);
+	uint64 nn_evals = nn_eval_count - bench_nn_eval_start;
+	uint64 forwards = search_stat[PHASE_FORWARD].count - bench_forward_start;
+	int n = bench_positions_n ? bench_positions_n : 1;
+
+	USIOut( "{\"positions\":%d,\"playouts\":%d,\"seconds\":%.3f,\"nps\":%.1f,"
+		"\"nn_evals\":%llu,\"nn_evals_per_sec\":%.1f,\"avg_batch\":%.2f,"
+		"\"hash_occupancy\":%.4f,\"batch_size\":%d,\"signature\":\"%016llx\",\"moves\":[%s]}\n",
+		bench_positions_n, bench_playouts, sec, bench_playouts / sec,
+		(unsigned long long)nn_evals, nn_evals / sec, forwards ? (double)nn_evals / forwards : 0.0,
+		bench_occupancy / n, (int)cfg_batch_size, (unsigned long long)bench_signature, bench_moves.c_str() );
+
+	fAddNoise         = bench_keep[0];
+	nVisitCount       = bench_keep[1];
+	nPlayoutCapFast   = bench_keep[2];
+	nResignWinratePct = bench_keep[3];
+	std::random_device rd;
+	init_rnd521( (int)time(NULL)+getpid_YSS() + rd() );	// 固定した乱数列を起動時と同じく戻す
+	fBenchRunning = 0;
+}
 
 void test_dist()
 {
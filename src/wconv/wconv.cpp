@@ -0,0 +1,148 @@
+// 2019 Team AobaZero
+// This source code is in the public domain.
+#include "err.hpp"
+#include "wbin.hpp"
+#include "xzi.hpp"
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <cassert>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::ifstream;
+using std::ios;
+using std::ofstream;
+using std::unique_ptr;
+using std::vector;
+using ErrAux::die;
+using uint = unsigned int;
+
+// Converts the text weights w*.txt to the binary format of wbin.hpp.
+// Either file is xz-compressed if its name ends with ".xz".
+static bool has_xz(const char *fname) noexcept {
+  size_t len = strlen(fname);
+  return 3U <= len && strcmp(fname + len - 3U, ".xz") == 0; }
+
+static vector<char> read_text(const char *fname) noexcept {
+  ifstream ifs(fname, ios::binary);
+  if (!ifs) die(ERR_INT("cannot open %s", fname));
+  if (!has_xz(fname)) {
+    ifs.seekg(0, ifs.end);
+    vector<char> text(static_cast<size_t>(ifs.tellg()));
+    ifs.seekg(0, ifs.beg);
+    if (!ifs.read(text.data(), text.size()))
+      die(ERR_INT("cannot read %s", fname));
+    return text; }
+
+  XZDecode<ifstream, DevNul> xzd_len;
+  DevNul dev_nul;
+  if (!xzd_len.decode(&ifs, &dev_nul, SIZE_MAX))
+    die(ERR_INT("cannot decode %s", fname));
+
+  vector<char> text(xzd_len.get_len_out());
+  ifs.clear();
+  ifs.seekg(0, ifs.beg);
+  PtrLen<char> pl(text.data(), 0);
+  XZDecode<ifstream, PtrLen<char>> xzd;
+  if (!xzd.decode(&ifs, &pl, text.size()) || pl.len != text.size())
+    die(ERR_INT("cannot decode %s", fname));
+  return text; }
+
+// each line, the version line included, as a vector of floats
+static vector<vector<float>> parse_text(vector<char> &text) noexcept {
+  vector<vector<float>> lines;
+  vector<float> line;
+  text.push_back('\0');
+  char *p = text.data();
+  while (true) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == ',') ++p;
+    if (*p == '\n' || *p == '\0') {
+      if (!line.empty()) lines.push_back(std::move(line));
+      line.clear();
+      if (*p == '\0') break;
+      ++p;
+      continue; }
+
+    char *endptr;
+    errno = 0;
+    float f = strtof(p, &endptr);
+    if (endptr == p || errno == ERANGE)
+      die(ERR_INT("bad value at line %zu", lines.size() + 1U));
+    line.push_back(f);
+    p = endptr; }
+  return lines; }
+
+static void write_bin(const char *fname, const vector<char> &bin) noexcept {
+  ofstream ofs(fname, ios::binary | ios::trunc);
+  if (!ofs) die(ERR_INT("cannot open %s", fname));
+  if (has_xz(fname)) {
+    PtrLen<const char> pl(bin.data(), bin.size());
+    XZEncode<PtrLen<const char>, ofstream> xze;
+    xze.start(&ofs, SIZE_MAX, 9);
+    if (!xze.append(&pl) || !xze.end())
+      die(ERR_INT("cannot encode %s", fname)); }
+  else ofs.write(bin.data(), bin.size());
+  ofs.close();
+  if (!ofs) die(ERR_INT("cannot write to %s", fname)); }
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    cerr << "Usage: " << argv[0] << " w.txt[.xz] w.bin[.xz]" << endl;
+    return 1; }
+
+  vector<char> text = read_text(argv[1]);
+  vector<vector<float>> lines = parse_text(text);
+  vector<char>().swap(text);
+  if (lines.empty() || lines[0].size() != 1U || lines[0][0] != 2.0f)
+    die(ERR_INT("%s is not the text weights of version 2", argv[1]));
+
+  size_t nsection = lines.size() - 1U;
+  if (nsection < WBin::nsection_fixed
+      || (nsection - WBin::nsection_fixed) % WBin::nsection_block)
+    die(ERR_INT("bad number of lines %zu", lines.size()));
+
+  WBin::Header head;
+  memset(&head, 0, sizeof(head));
+  memcpy(head.magic, WBin::magic, sizeof(head.magic));
+  head.version      = WBin::version;
+  head.version_text = 2U;
+  head.nblock   = static_cast<uint32_t>((nsection - WBin::nsection_fixed)
+					/ WBin::nsection_block);
+  head.nchannel = static_cast<uint32_t>(lines[2].size());
+  head.nsection = static_cast<uint32_t>(nsection);
+
+  size_t len = WBin::size_head + WBin::align_up(sizeof(uint64_t) * nsection);
+  for (size_t u = 1; u <= nsection; ++u)
+    len += WBin::align_up(sizeof(float) * lines[u].size());
+
+  vector<char> bin(len, 0);
+  char *p = bin.data() + WBin::size_head;
+  for (size_t u = 1; u <= nsection; ++u) {
+    uint64_t count = lines[u].size();
+    memcpy(p, &count, sizeof(count));
+    p += sizeof(count); }
+
+  size_t offset = WBin::size_head
+    + WBin::align_up(sizeof(uint64_t) * nsection);
+  for (size_t u = 1; u <= nsection; ++u) {
+    size_t size = sizeof(float) * lines[u].size();
+    memcpy(bin.data() + offset, lines[u].data(), size);
+    offset += WBin::align_up(size); }
+  assert(offset == len);
+
+  head.crc64 = XZAux::crc64(bin.data() + WBin::size_head,
+			    len - WBin::size_head, 0);
+  memcpy(bin.data(), &head, sizeof(head));
+  write_bin(argv[2], bin);
+
+  printf("%s: %u blocks, %u channels, %zu bytes, crc64 %016" PRIx64 "\n",
+	 argv[2], head.nblock, head.nchannel, len, head.crc64);
+  return 0; }